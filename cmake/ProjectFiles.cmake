@@ -6,4 +6,37 @@ list(APPEND flex_reflect_plugin_SOURCES
   ${flex_reflect_plugin_src_DIR}/EventHandler.cc
   ${flex_reflect_plugin_include_DIR}/Tooling.hpp
   ${flex_reflect_plugin_src_DIR}/Tooling.cc
+  ${flex_reflect_plugin_include_DIR}/RuleChain.hpp
+  ${flex_reflect_plugin_src_DIR}/RuleChain.cc
+  ${flex_reflect_plugin_include_DIR}/Settings.hpp
+  ${flex_reflect_plugin_src_DIR}/Settings.cc
+  ${flex_reflect_plugin_include_DIR}/GeneratedFileWriter.hpp
+  ${flex_reflect_plugin_src_DIR}/GeneratedFileWriter.cc
+  ${flex_reflect_plugin_include_DIR}/DependencyTracker.hpp
+  ${flex_reflect_plugin_src_DIR}/DependencyTracker.cc
+  ${flex_reflect_plugin_include_DIR}/SnippetValidator.hpp
+  ${flex_reflect_plugin_src_DIR}/SnippetValidator.cc
+  ${flex_reflect_plugin_include_DIR}/TraceRecorder.hpp
+  ${flex_reflect_plugin_src_DIR}/TraceRecorder.cc
+  ${flex_reflect_plugin_include_DIR}/HeaderRewriteCache.hpp
+  ${flex_reflect_plugin_src_DIR}/HeaderRewriteCache.cc
+  ${flex_reflect_plugin_include_DIR}/ReflectEdits.hpp
+  ${flex_reflect_plugin_include_DIR}/EditApplier.hpp
+  ${flex_reflect_plugin_src_DIR}/EditApplier.cc
+  ${flex_reflect_plugin_include_DIR}/StreamingReplacementSink.hpp
+  ${flex_reflect_plugin_src_DIR}/StreamingReplacementSink.cc
+  ${flex_reflect_plugin_include_DIR}/SnippetWatchdog.hpp
+  ${flex_reflect_plugin_src_DIR}/SnippetWatchdog.cc
+  # used only by annotation_tokenizer_perftest
+  ${flex_reflect_plugin_include_DIR}/AnnotationTokenizer.hpp
+  ${flex_reflect_plugin_src_DIR}/AnnotationTokenizer.cc
+  ${flex_reflect_plugin_include_DIR}/HashEqRule.hpp
+  ${flex_reflect_plugin_src_DIR}/HashEqRule.cc
+  ${flex_reflect_plugin_include_DIR}/PooledRule.hpp
+  ${flex_reflect_plugin_src_DIR}/PooledRule.cc
+  ${flex_reflect_plugin_include_DIR}/AnnotationPrescanner.hpp
+  ${flex_reflect_plugin_src_DIR}/AnnotationPrescanner.cc
+  ${flex_reflect_plugin_include_DIR}/AnnotationMethods.hpp
+  ${flex_reflect_plugin_include_DIR}/VisitorRule.hpp
+  ${flex_reflect_plugin_src_DIR}/VisitorRule.cc
 )
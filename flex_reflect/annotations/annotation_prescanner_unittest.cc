@@ -0,0 +1,72 @@
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp>
+
+#include <flex_reflect_plugin/AnnotationMethods.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+std::vector<std::string> MethodTokens()
+{
+  return std::vector<std::string>(
+    std::begin(kAnnotationMethods), std::end(kAnnotationMethods));
+}
+
+} // namespace
+
+TEST(AnnotationPrescannerTest, FindsTokenOfEachMethod)
+{
+  for(const std::string& token : MethodTokens()) {
+    const std::string code
+      = "struct __attribute__((annotate(\"{gen};"
+        + token
+        + "make_reflect;\"))) S {};\n";
+    EXPECT_TRUE(AnnotationPrescanner::ContainsAnyToken(
+      code, MethodTokens())) << token;
+  }
+}
+
+TEST(AnnotationPrescannerTest, IgnoresBracesWithoutTokens)
+{
+  // braces are frequent in C++ code
+  std::string code;
+  for(int i = 0; i < 100; i++) {
+    code += "namespace n { struct S { void f() { if(x) { g({1, 2}); } } }; }\n";
+  }
+  code += "const char* text = \"{funccall}\";\n";
+  code += "const char* other = \"{executeCode;\";\n";
+  EXPECT_FALSE(AnnotationPrescanner::ContainsAnyToken(
+    code, MethodTokens()));
+}
+
+TEST(AnnotationPrescannerTest, ComparesAllTokensWithCommonPrefix)
+{
+  // `{executeCode` is common prefix of three tokens
+  EXPECT_FALSE(AnnotationPrescanner::ContainsAnyToken(
+    "{executeCodeAndPrint};{executeCode;", MethodTokens()));
+  EXPECT_TRUE(AnnotationPrescanner::ContainsAnyToken(
+    "{executeCodeAndPrint};{executeCodeAndReplace};", MethodTokens()));
+  EXPECT_TRUE(AnnotationPrescanner::ContainsAnyToken(
+    "{executeCodeAndPrint};{executeCode};", MethodTokens()));
+}
+
+TEST(AnnotationPrescannerTest, FindsTokenAtBoundsOfData)
+{
+  EXPECT_TRUE(AnnotationPrescanner::ContainsAnyToken(
+    kFunccallMethod, MethodTokens()));
+  EXPECT_TRUE(AnnotationPrescanner::ContainsAnyToken(
+    std::string("{{{") + kExecuteCodeAndEditMethod, MethodTokens()));
+  // token cut by end of data
+  EXPECT_FALSE(AnnotationPrescanner::ContainsAnyToken(
+    "{funccall}", MethodTokens()));
+  EXPECT_FALSE(AnnotationPrescanner::ContainsAnyToken(
+    "", MethodTokens()));
+}
+
+} // namespace plugin
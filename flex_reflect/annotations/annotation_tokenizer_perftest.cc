@@ -0,0 +1,94 @@
+#include <flex_reflect_plugin/AnnotationTokenizer.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <flexlib/funcParser.hpp>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/time/time.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+static const int kIterations = 1000;
+
+// annotation of generated type with long argument lists
+std::string LongAnnotation(int numCalls, int numArgs)
+{
+  std::string annotation;
+  for(int call = 0; call < numCalls; call++) {
+    annotation += "make_rule_" + base::NumberToString(call) + "(";
+    for(int arg = 0; arg < numArgs; arg++) {
+      if(arg) {
+        annotation += ", ";
+      }
+      annotation += "field_" + base::NumberToString(arg)
+        + "=\"value;" + base::NumberToString(arg) + "\"";
+    }
+    annotation += ");";
+  }
+  return annotation;
+}
+
+template <typename Function>
+base::TimeDelta Measure(Function function)
+{
+  const base::TimeTicks start = base::TimeTicks::Now();
+  for(int i = 0; i < kIterations; i++) {
+    function();
+  }
+  return base::TimeTicks::Now() - start;
+}
+
+void RunCorpus(const std::string& name, const std::string& annotation)
+{
+  size_t sink = 0;
+
+  const base::TimeDelta splitToFuncs = Measure([&]() {
+    sink += ::flexlib::split_to_funcs(annotation).size();
+  });
+
+  const base::TimeDelta scalar = Measure([&]() {
+    sink += TokenizeAnnotation(annotation, DelimiterScanner::kScalar).size();
+  });
+
+  const base::TimeDelta best = Measure([&]() {
+    sink += TokenizeAnnotation(annotation, DefaultDelimiterScanner()).size();
+  });
+
+  LOG(INFO)
+    << name
+    << " (" << annotation.size() << " bytes, "
+    << kIterations << " iterations):"
+    << " split_to_funcs " << splitToFuncs.InMicroseconds() << " us,"
+    << " scalar tokenizer " << scalar.InMicroseconds() << " us,"
+    << " tokenizer (scanner "
+    << static_cast<int>(DefaultDelimiterScanner()) << ") "
+    << best.InMicroseconds() << " us";
+
+  EXPECT_GT(sink, 0u);
+}
+
+} // namespace
+
+TEST(AnnotationTokenizerPerfTest, ShortAnnotation)
+{
+  RunCorpus("short", "make_reflect;make_hash;");
+}
+
+TEST(AnnotationTokenizerPerfTest, LongArgumentLists)
+{
+  RunCorpus("long arguments", LongAnnotation(4, 200));
+}
+
+TEST(AnnotationTokenizerPerfTest, ManyCalls)
+{
+  RunCorpus("many calls", LongAnnotation(200, 4));
+}
+
+} // namespace plugin
@@ -0,0 +1,93 @@
+#include <flex_reflect_plugin/AnnotationTokenizer.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/cpu.h>
+#include <build/build_config.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+// scanners supported by CPU of test machine
+std::vector<DelimiterScanner> SupportedScanners()
+{
+  std::vector<DelimiterScanner> scanners{DelimiterScanner::kScalar};
+#if defined(ARCH_CPU_X86_FAMILY)
+  const base::CPU cpu;
+  if(cpu.has_sse42()) {
+    scanners.push_back(DelimiterScanner::kSse42);
+  }
+  if(cpu.has_avx2()) {
+    scanners.push_back(DelimiterScanner::kAvx2);
+  }
+#endif // ARCH_CPU_X86_FAMILY
+  return scanners;
+}
+
+} // namespace
+
+TEST(AnnotationTokenizerTest, FindsSameDelimitersWithAllScanners)
+{
+  // longer than AVX2 register, tail is handled by scalar code
+  std::string text;
+  for(int i = 0; i < 10; i++) {
+    text += "make_reflect(name=\"x;y\", other = f(1, 2));\t";
+  }
+
+  std::vector<uint32_t> expected;
+  for(size_t i = 0; i < text.size(); i++) {
+    if(IsAnnotationDelimiter(text[i])) {
+      expected.push_back(static_cast<uint32_t>(i));
+    }
+  }
+
+  for(DelimiterScanner scanner : SupportedScanners()) {
+    std::vector<uint32_t> offsets;
+    FindAnnotationDelimiters(scanner, text, &offsets);
+    EXPECT_EQ(expected, offsets)
+      << "scanner: " << static_cast<int>(scanner);
+  }
+}
+
+TEST(AnnotationTokenizerTest, SplitsCallsAndArguments)
+{
+  const std::string annotation
+    = "make_reflect; make_hash(seed=1, \"a;b(\\\"\", f(x, y)) ;; last";
+
+  for(DelimiterScanner scanner : SupportedScanners()) {
+    const std::vector<AnnotationCall> calls
+      = TokenizeAnnotation(annotation, scanner);
+    ASSERT_EQ(3u, calls.size());
+
+    EXPECT_EQ("make_reflect", calls[0].name);
+    EXPECT_TRUE(calls[0].args.empty());
+
+    EXPECT_EQ("make_hash", calls[1].name);
+    ASSERT_EQ(3u, calls[1].args.size());
+    EXPECT_EQ("seed", calls[1].args[0].name);
+    EXPECT_EQ("1", calls[1].args[0].value);
+    EXPECT_TRUE(calls[1].args[1].name.empty());
+    EXPECT_EQ("\"a;b(\\\"\"", calls[1].args[1].value);
+    EXPECT_EQ("f(x, y)", calls[1].args[2].value);
+
+    EXPECT_EQ("last", calls[2].name);
+  }
+}
+
+TEST(AnnotationTokenizerTest, ReturnsViewsIntoAnnotation)
+{
+  const std::string annotation = "make_reflect(a);";
+
+  const std::vector<AnnotationCall> calls
+    = TokenizeAnnotation(annotation);
+  ASSERT_EQ(1u, calls.size());
+  EXPECT_EQ(annotation.data(), calls[0].name.data());
+  ASSERT_EQ(1u, calls[0].args.size());
+  EXPECT_EQ(annotation.data() + 13, calls[0].args[0].value.data());
+}
+
+} // namespace plugin
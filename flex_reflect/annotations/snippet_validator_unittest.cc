@@ -0,0 +1,64 @@
+#include <flex_reflect_plugin/SnippetValidator.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/Decl.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <memory>
+#include <set>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+// later snippets use declarations and includes of earlier snippets
+const char kCode[] =
+  "__attribute__((annotate(\"{gen};{executeCode};"
+    "#include <string>\\nstd::string name = \\\"a\\\";\")))\n"
+  "int declaresName;\n"
+  "__attribute__((annotate(\"{gen};{executeCode};"
+    "name += std::to_string(2);\")))\n"
+  "int usesName;\n"
+  "__attribute__((annotate(\"{gen};{executeCode};"
+    "undeclared = 3;\")))\n"
+  "int invalid;\n";
+
+// returns names of variables annotated with invalid code
+std::set<std::string> InvalidSnippetNames(
+  clang::ASTContext& context
+  , const std::set<const clang::AnnotateAttr*>& invalidSnippets)
+{
+  std::set<std::string> names;
+  for(const clang::Decl* decl
+        : context.getTranslationUnitDecl()->decls())
+  {
+    const auto* var = llvm::dyn_cast<clang::VarDecl>(decl);
+    if(var && invalidSnippets.count(var->getAttr<clang::AnnotateAttr>())) {
+      names.insert(var->getNameAsString());
+    }
+  }
+  return names;
+}
+
+} // namespace
+
+TEST(SnippetValidatorTest, ValidatesSnippetsAsGrowingTranslationUnit)
+{
+  std::unique_ptr<clang::ASTUnit> ast
+    = clang::tooling::buildASTFromCodeWithArgs(
+        kCode, {"-std=c++17"}, "/src/main.cpp");
+  ASSERT_TRUE(ast);
+
+  SnippetValidator validator({"-std=c++17"}, 2);
+  const std::set<const clang::AnnotateAttr*> invalidSnippets
+    = validator.ValidateTranslationUnit(ast->getASTContext(), nullptr);
+  EXPECT_EQ(std::set<std::string>{"invalid"}
+            , InvalidSnippetNames(ast->getASTContext(), invalidSnippets));
+}
+
+} // namespace plugin
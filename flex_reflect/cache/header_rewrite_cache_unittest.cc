@@ -0,0 +1,283 @@
+#include <flex_reflect_plugin/HeaderRewriteCache.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <base/bind.h>
+#include <base/files/file_path.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/optional.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+const char kHeaderPath[] = "/virtual/reflected.hpp";
+
+const char kHeaderCode[] =
+  "#pragma once\n"
+  "#if defined(LONG_ID)\n"
+  "using Id = long;\n"
+  "#else\n"
+  "using Id = int;\n"
+  "#endif\n"
+  "struct __attribute__((annotate(\"{gen};{funccall};make_reflect;\")))\n"
+  "Reflected {\n"
+  "  Id id;\n"
+  "  FIELD_TYPE value;\n"
+  "};\n";
+
+const char kMainCode[] =
+  "#define FIELD_TYPE int\n"
+  "#include \"/virtual/reflected.hpp\"\n";
+
+// header with interpreted code, its snippets must run in every
+// translation unit
+const char kInterpretedHeaderCode[] =
+  "#pragma once\n"
+  "struct __attribute__((annotate(\"{gen};{executeCodeAndReplace};"
+    "new llvm::Optional<std::string>{\\\"int id;\\\"};\")))\n"
+  "Reflected {\n"
+  "  FIELD_TYPE value;\n"
+  "};\n";
+
+std::unique_ptr<clang::ASTUnit> BuildAST(
+  const std::string& mainCode
+  , const std::vector<std::string>& args = {}
+  , const std::string& headerCode = kHeaderCode)
+{
+  std::unique_ptr<clang::ASTUnit> ast
+    = clang::tooling::buildASTFromCodeWithArgs(
+        mainCode
+        , args
+        , "/src/main.cpp"
+        , "flex_reflect_unittests"
+        , std::make_shared<clang::PCHContainerOperations>()
+        , clang::tooling::getClangStripDependencyFileAdjuster()
+        , clang::tooling::FileContentMappings{{kHeaderPath, headerCode}});
+  EXPECT_TRUE(ast);
+  return ast;
+}
+
+std::string ComputeHeaderKey(
+  clang::ASTUnit& ast)
+{
+  base::ScopedTempDir tempDir;
+  EXPECT_TRUE(tempDir.CreateUniqueTempDir());
+  HeaderRewriteCache cache(tempDir.GetPath());
+  const std::map<base::FilePath, HeaderRewriteCache::HeaderKey> keys
+    = cache.ComputeHeaderKeys(ast.getASTContext(), "rules", nullptr);
+  auto it = keys.find(base::FilePath{kHeaderPath});
+  return it == keys.end() ? std::string{} : it->second.key;
+}
+
+clang::FileID HeaderFileID(
+  clang::ASTUnit& ast)
+{
+  const clang::SourceManager& sourceManager = ast.getSourceManager();
+  for(const clang::Decl* decl
+        : ast.getASTContext().getTranslationUnitDecl()->decls())
+  {
+    const auto* record = llvm::dyn_cast<clang::CXXRecordDecl>(decl);
+    if(record && record->getName() == "Reflected") {
+      return sourceManager.getFileID(
+        sourceManager.getExpansionLoc(record->getBeginLoc()));
+    }
+  }
+  ADD_FAILURE() << "Reflected is not declared";
+  return clang::FileID{};
+}
+
+void AddDisabledFile(
+  std::set<clang::FileID>* disabledFiles
+  , clang::FileID fileID)
+{
+  disabledFiles->insert(fileID);
+}
+
+} // namespace
+
+TEST(HeaderRewriteCacheTest, StoresRewrittenAndUnchangedHeaders)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  HeaderRewriteCache cache(tempDir.GetPath());
+
+  base::Optional<std::string> contents;
+  EXPECT_FALSE(cache.Lookup("rewritten", &contents));
+
+  cache.Store("rewritten", std::string{"struct Reflected {};"});
+  ASSERT_TRUE(cache.Lookup("rewritten", &contents));
+  ASSERT_TRUE(contents);
+  EXPECT_EQ("struct Reflected {};", *contents);
+
+  // header without rewrite must be cached too,
+  // otherwise it is processed again by every translation unit
+  cache.Store("unchanged", base::nullopt);
+  ASSERT_TRUE(cache.Lookup("unchanged", &contents));
+  EXPECT_FALSE(contents);
+}
+
+TEST(HeaderRewriteCacheTest, SameKeyForSamePreprocessorState)
+{
+  std::unique_ptr<clang::ASTUnit> first = BuildAST(kMainCode);
+  std::unique_ptr<clang::ASTUnit> second = BuildAST(kMainCode);
+  ASSERT_TRUE(first && second);
+
+  const std::string key = ComputeHeaderKey(*first);
+  EXPECT_FALSE(key.empty());
+  EXPECT_EQ(key, ComputeHeaderKey(*second));
+}
+
+TEST(HeaderRewriteCacheTest, HeaderWithInterpretedCodeIsNotCached)
+{
+  std::unique_ptr<clang::ASTUnit> ast
+    = BuildAST(kMainCode, {}, kInterpretedHeaderCode);
+  ASSERT_TRUE(ast);
+
+  EXPECT_TRUE(ComputeHeaderKey(*ast).empty());
+}
+
+TEST(HeaderRewriteCacheTest, KeyDependsOnCommandLineMacros)
+{
+  std::unique_ptr<clang::ASTUnit> plain = BuildAST(kMainCode);
+  std::unique_ptr<clang::ASTUnit> defined
+    = BuildAST(kMainCode, {"-DLONG_ID"});
+  ASSERT_TRUE(plain && defined);
+
+  EXPECT_NE(ComputeHeaderKey(*plain), ComputeHeaderKey(*defined));
+}
+
+TEST(HeaderRewriteCacheTest, KeyDependsOnMacrosDefinedBeforeInclude)
+{
+  // same offsets of macro definitions, different macro bodies
+  std::unique_ptr<clang::ASTUnit> intField = BuildAST(kMainCode);
+  std::unique_ptr<clang::ASTUnit> charField = BuildAST(
+    "#define FIELD_TYPE chr\n"
+    "typedef char chr;\n"
+    "#include \"/virtual/reflected.hpp\"\n");
+  ASSERT_TRUE(intField && charField);
+
+  EXPECT_NE(ComputeHeaderKey(*intField), ComputeHeaderKey(*charField));
+}
+
+TEST(HeaderRewriteCacheTest, SignatureChangesOnlyForEditedFile)
+{
+  std::unique_ptr<clang::ASTUnit> ast = BuildAST(kMainCode);
+  ASSERT_TRUE(ast);
+  clang::SourceManager& sourceManager = ast->getSourceManager();
+  clang::Rewriter rewriter(sourceManager, ast->getLangOpts());
+  const clang::FileID mainFile = sourceManager.getMainFileID();
+  const clang::FileID headerFile = HeaderFileID(*ast);
+
+  EXPECT_TRUE(RewriteBufferSignatures(rewriter).empty());
+
+  rewriter.InsertTextAfter(
+    sourceManager.getLocForEndOfFile(headerFile), "// edited\n");
+  const std::map<clang::FileID, size_t> headerEdited
+    = RewriteBufferSignatures(rewriter);
+  ASSERT_EQ(1u, headerEdited.size());
+  EXPECT_EQ(1u, headerEdited.count(headerFile));
+
+  // replacement by text of same length changes signature too
+  rewriter.ReplaceText(
+    sourceManager.getLocForStartOfFile(mainFile), 7, "#define");
+  const std::map<clang::FileID, size_t> mainEdited
+    = RewriteBufferSignatures(rewriter);
+  ASSERT_EQ(2u, mainEdited.size());
+  EXPECT_EQ(headerEdited.at(headerFile), mainEdited.at(headerFile));
+
+  // repeated edit of already edited buffer
+  rewriter.ReplaceText(
+    sourceManager.getLocForStartOfFile(mainFile), 7, "#define");
+  EXPECT_NE(mainEdited.at(mainFile)
+    , RewriteBufferSignatures(rewriter).at(mainFile));
+}
+
+TEST(HeaderRewriteCacheTest, KeepsHeaderThatEditedOnlyItself)
+{
+  std::unique_ptr<clang::ASTUnit> ast = BuildAST(kMainCode);
+  ASSERT_TRUE(ast);
+  clang::SourceManager& sourceManager = ast->getSourceManager();
+  clang::Rewriter rewriter(sourceManager, ast->getLangOpts());
+  const clang::FileID headerFile = HeaderFileID(*ast);
+
+  std::set<clang::FileID> disabledFiles;
+  {
+    ScopedHeaderCacheCheck check(rewriter, headerFile
+      , base::BindRepeating(&AddDisabledFile, &disabledFiles));
+    rewriter.InsertTextAfter(
+      sourceManager.getLocForEndOfFile(headerFile), "// generated\n");
+    check.MarkSucceeded();
+  }
+  EXPECT_TRUE(disabledFiles.empty());
+}
+
+TEST(HeaderRewriteCacheTest, DisablesHeaderThatEditedOtherFile)
+{
+  std::unique_ptr<clang::ASTUnit> ast = BuildAST(kMainCode);
+  ASSERT_TRUE(ast);
+  clang::SourceManager& sourceManager = ast->getSourceManager();
+  clang::Rewriter rewriter(sourceManager, ast->getLangOpts());
+  const clang::FileID mainFile = sourceManager.getMainFileID();
+  const clang::FileID headerFile = HeaderFileID(*ast);
+
+  std::set<clang::FileID> disabledFiles;
+  {
+    ScopedHeaderCacheCheck check(rewriter, headerFile
+      , base::BindRepeating(&AddDisabledFile, &disabledFiles));
+    // edit of main file would be lost on cache hit of header
+    rewriter.ReplaceText(
+      sourceManager.getLocForStartOfFile(mainFile), 7, "#define");
+    check.MarkSucceeded();
+  }
+  EXPECT_EQ((std::set<clang::FileID>{mainFile, headerFile}), disabledFiles);
+}
+
+TEST(HeaderRewriteCacheTest, DisablesHeaderEditedByOtherFile)
+{
+  std::unique_ptr<clang::ASTUnit> ast = BuildAST(kMainCode);
+  ASSERT_TRUE(ast);
+  clang::SourceManager& sourceManager = ast->getSourceManager();
+  clang::Rewriter rewriter(sourceManager, ast->getLangOpts());
+  const clang::FileID mainFile = sourceManager.getMainFileID();
+  const clang::FileID headerFile = HeaderFileID(*ast);
+
+  std::set<clang::FileID> disabledFiles;
+  {
+    ScopedHeaderCacheCheck check(rewriter, mainFile
+      , base::BindRepeating(&AddDisabledFile, &disabledFiles));
+    rewriter.InsertTextAfter(
+      sourceManager.getLocForEndOfFile(headerFile), "// generated\n");
+    check.MarkSucceeded();
+  }
+  EXPECT_EQ(1u, disabledFiles.count(headerFile));
+}
+
+TEST(HeaderRewriteCacheTest, DisablesHeaderOfFailedAnnotation)
+{
+  std::unique_ptr<clang::ASTUnit> ast = BuildAST(kMainCode);
+  ASSERT_TRUE(ast);
+  clang::Rewriter rewriter(ast->getSourceManager(), ast->getLangOpts());
+  const clang::FileID headerFile = HeaderFileID(*ast);
+
+  std::set<clang::FileID> disabledFiles;
+  {
+    ScopedHeaderCacheCheck check(rewriter, headerFile
+      , base::BindRepeating(&AddDisabledFile, &disabledFiles));
+  }
+  EXPECT_EQ((std::set<clang::FileID>{headerFile}), disabledFiles);
+}
+
+} // namespace plugin
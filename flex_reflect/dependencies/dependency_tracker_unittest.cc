@@ -0,0 +1,63 @@
+#include <flex_reflect_plugin/DependencyTracker.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/files/file_path.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+TEST(DependencyTrackerTest, EscapesDepfilePath)
+{
+  EXPECT_EQ("/src/main.cpp"
+    , EscapeDepfilePath(base::FilePath{"/src/main.cpp"}));
+  EXPECT_EQ("/my\\ src/a\\#b$$c.hpp"
+    , EscapeDepfilePath(base::FilePath{"/my src/a#b$c.hpp"}));
+}
+
+TEST(DependencyTrackerTest, ParsesSnippetIncludes)
+{
+  const std::vector<SnippetInclude> includes = ParseSnippetIncludes(
+    "#include <vector>\n"
+    "#include\t \"local/header.hpp\"\n"
+    "#include SOME_MACRO\n"
+    "int a = 1; #include <string>");
+  ASSERT_EQ(3u, includes.size());
+
+  EXPECT_EQ("vector", includes[0].name);
+  EXPECT_FALSE(includes[0].isQuoted);
+
+  EXPECT_EQ("local/header.hpp", includes[1].name);
+  EXPECT_TRUE(includes[1].isQuoted);
+
+  EXPECT_EQ("string", includes[2].name);
+  EXPECT_FALSE(includes[2].isQuoted);
+}
+
+TEST(DependencyTrackerTest, IgnoresUnterminatedSnippetInclude)
+{
+  EXPECT_TRUE(ParseSnippetIncludes("#include").empty());
+  EXPECT_TRUE(ParseSnippetIncludes("#include <vector").empty());
+  EXPECT_TRUE(ParseSnippetIncludes("no includes").empty());
+}
+
+TEST(DependencyTrackerTest, FormatsDepfileWithSnippetIncludes)
+{
+  DependencyTracker tracker;
+  const base::FilePath sourceFile{"/src/main.cpp"};
+  tracker.AddCommonDependency(base::FilePath{"/lib/plugin.so"});
+  // absolute paths are resolved without access to file system
+  tracker.AddSnippetIncludes(sourceFile, "#include </inc/a b.hpp>");
+
+  EXPECT_EQ(
+    "/out/main.cpp.generated.cpp: \\\n"
+    "  /inc/a\\ b.hpp \\\n"
+    "  /lib/plugin.so \\\n"
+    "  /src/main.cpp\n"
+    , tracker.FormatDepfile(
+        sourceFile, base::FilePath{"/out/main.cpp.generated.cpp"}));
+}
+
+} // namespace plugin
@@ -0,0 +1,106 @@
+#include <flex_reflect_plugin/EditApplier.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <memory>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+const char kMainCode[] =
+  "#include <included.hpp>\n"
+  "// #include <mentioned.hpp>\n"
+  "struct Reflected {};\n";
+
+class EditApplierTest : public testing::Test {
+protected:
+  void SetUp() override
+  {
+    ast_ = clang::tooling::buildASTFromCodeWithArgs(
+      kMainCode
+      , {"-I/virtual"}
+      , "/src/main.cpp"
+      , "flex_reflect_unittests"
+      , std::make_shared<clang::PCHContainerOperations>()
+      , clang::tooling::getClangStripDependencyFileAdjuster()
+      , clang::tooling::FileContentMappings{
+          {"/virtual/included.hpp", "#pragma once\n"}
+          , {"/virtual/mentioned.hpp", "#pragma once\n"}});
+    ASSERT_TRUE(ast_);
+    rewriter_ = std::make_unique<clang::Rewriter>(
+      ast_->getSourceManager(), ast_->getLangOpts());
+
+    for(const clang::Decl* decl
+          : ast_->getASTContext().getTranslationUnitDecl()->decls())
+    {
+      const auto* record = llvm::dyn_cast<clang::RecordDecl>(decl);
+      if(record && record->getName() == "Reflected") {
+        reflected_ = record;
+      }
+    }
+    ASSERT_TRUE(reflected_);
+  }
+
+  std::string RewrittenMainFile() const
+  {
+    const clang::RewriteBuffer* buffer = rewriter_->getRewriteBufferFor(
+      ast_->getSourceManager().getMainFileID());
+    return buffer
+      ? std::string(buffer->begin(), buffer->end())
+      : std::string(kMainCode);
+  }
+
+  std::unique_ptr<clang::ASTUnit> ast_;
+  std::unique_ptr<clang::Rewriter> rewriter_;
+  const clang::Decl* reflected_ = nullptr;
+};
+
+} // namespace
+
+TEST_F(EditApplierTest, SkipsHeaderIncludedByPreprocessor)
+{
+  // other form of same header
+  AddIncludeOnce(*rewriter_, reflected_, "\"included.hpp\"");
+  AddIncludeOnce(*rewriter_, reflected_, " <included.hpp> ");
+  // same header relative to other include path
+  AddIncludeOnce(*rewriter_, reflected_, "</virtual/included.hpp>");
+  EXPECT_EQ(kMainCode, RewrittenMainFile());
+}
+
+TEST_F(EditApplierTest, AddsHeaderMentionedOnlyInComment)
+{
+  AddIncludeOnce(*rewriter_, reflected_, "<mentioned.hpp>");
+  // include added by previous edit
+  AddIncludeOnce(*rewriter_, reflected_, "<mentioned.hpp>");
+  EXPECT_EQ(std::string("#include <mentioned.hpp>\n") + kMainCode
+    , RewrittenMainFile());
+}
+
+TEST_F(EditApplierTest, AppliesEditsInOrder)
+{
+  ApplyReflectEdits(*rewriter_, reflected_, ReflectEdits{}
+    .AddInclude("<vector>")
+    .AddInclude("<included.hpp>")
+    .InsertBefore("/*before*/")
+    .Replace("struct Replaced {}")
+    .InsertAfter("/*after*/")
+    .AppendToFile("/*end*/\n")
+    .AddInclude("<vector>"));
+  EXPECT_EQ(
+    "#include <vector>\n"
+    "#include <included.hpp>\n"
+    "// #include <mentioned.hpp>\n"
+    "/*before*/struct Replaced {}/*after*/;\n"
+    "/*end*/\n"
+    , RewrittenMainFile());
+}
+
+} // namespace plugin
@@ -0,0 +1,96 @@
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/files/file.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/time/time.h>
+
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+base::Time LastModified(
+  const base::FilePath& path)
+{
+  base::File::Info info;
+  EXPECT_TRUE(base::GetFileInfo(path, &info));
+  return info.last_modified;
+}
+
+} // namespace
+
+TEST(GeneratedFileWriterTest, SkipsUnchangedFile)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  const base::FilePath path
+    = tempDir.GetPath().AppendASCII("dir").AppendASCII("main.cpp");
+
+  GeneratedFileWriter writer("generated files");
+  ASSERT_TRUE(writer.WriteIfChanged(path, "int a;"));
+  EXPECT_EQ(1u, writer.writtenFiles());
+  EXPECT_EQ(0u, writer.skippedFiles());
+
+  // unchanged file must keep its modification time
+  const base::Time oldTime = base::Time::Now() - base::TimeDelta::FromHours(1);
+  ASSERT_TRUE(base::TouchFile(path, oldTime, oldTime));
+  const base::Time lastModified = LastModified(path);
+
+  ASSERT_TRUE(writer.WriteIfChanged(path, "int a;"));
+  EXPECT_EQ(1u, writer.writtenFiles());
+  EXPECT_EQ(1u, writer.skippedFiles());
+  EXPECT_EQ(lastModified, LastModified(path));
+}
+
+TEST(GeneratedFileWriterTest, RewritesChangedFile)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  const base::FilePath path = tempDir.GetPath().AppendASCII("main.cpp");
+
+  GeneratedFileWriter writer("generated files");
+  ASSERT_TRUE(writer.WriteIfChanged(path, "int a;"));
+  // same size, other contents
+  ASSERT_TRUE(writer.WriteIfChanged(path, "int b;"));
+  ASSERT_TRUE(writer.WriteIfChanged(path, ""));
+  EXPECT_EQ(3u, writer.writtenFiles());
+  EXPECT_EQ(0u, writer.skippedFiles());
+
+  std::string contents = "not empty";
+  ASSERT_TRUE(base::ReadFileToString(path, &contents));
+  EXPECT_TRUE(contents.empty());
+}
+
+TEST(GeneratedFilePathTest, KeepsPathRelativeToSourceRoot)
+{
+  const base::FilePath outputDir{"/out"};
+  const base::FilePath sourceRoot{"/src"};
+
+  EXPECT_EQ(base::FilePath{"/out/main.cpp.generated.cpp"}
+    , GeneratedFilePath(outputDir, sourceRoot, base::FilePath{"/src/main.cpp"}));
+  EXPECT_EQ(base::FilePath{"/out/a/foo.hpp.generated.hpp"}
+    , GeneratedFilePath(outputDir, sourceRoot, base::FilePath{"/src/a/foo.hpp"}));
+  EXPECT_EQ(base::FilePath{"/out/b/foo.hpp.generated.hpp"}
+    , GeneratedFilePath(outputDir, sourceRoot, base::FilePath{"/src/b/foo.hpp"}));
+}
+
+TEST(GeneratedFilePathTest, StoresExternalFilesByAbsolutePath)
+{
+  const base::FilePath outputDir{"/out"};
+  const base::FilePath sourceRoot{"/src"};
+
+  EXPECT_EQ(base::FilePath{"/out/_external/usr/include/foo.h.generated.h"}
+    , GeneratedFilePath(
+        outputDir, sourceRoot, base::FilePath{"/usr/include/foo.h"}));
+  // prefix of root name is not parent directory
+  EXPECT_EQ(base::FilePath{"/out/_external/src2/foo.h.generated.h"}
+    , GeneratedFilePath(
+        outputDir, sourceRoot, base::FilePath{"/src2/foo.h"}));
+}
+
+} // namespace plugin
@@ -0,0 +1,229 @@
+#include <flex_reflect_plugin/StreamingReplacementSink.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Decl.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <base/files/file.h>
+#include <base/files/file_enumerator.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+#include <base/files/scoped_temp_dir.h>
+#include <base/time/time.h>
+
+#include <memory>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+const char kMainCode[] =
+  "struct Reflected {};\n"
+  "int tail;\n";
+
+// rewriter of AST built from |kMainCode|
+class RewrittenMainFile {
+public:
+  RewrittenMainFile()
+  {
+    ast_ = clang::tooling::buildASTFromCode(kMainCode, "/src/main.cpp");
+    EXPECT_TRUE(ast_);
+    rewriter_ = std::make_unique<clang::Rewriter>(
+      ast_->getSourceManager(), ast_->getLangOpts());
+
+    for(const clang::Decl* decl
+          : ast_->getASTContext().getTranslationUnitDecl()->decls())
+    {
+      const auto* record = llvm::dyn_cast<clang::RecordDecl>(decl);
+      if(record && record->getName() == "Reflected") {
+        reflected_ = record;
+      }
+    }
+    EXPECT_TRUE(reflected_);
+  }
+
+  std::string Contents() const
+  {
+    const clang::RewriteBuffer* buffer = rewriter_->getRewriteBufferFor(
+      ast_->getSourceManager().getMainFileID());
+    return buffer
+      ? std::string(buffer->begin(), buffer->end())
+      : std::string(kMainCode);
+  }
+
+  clang::Rewriter& rewriter()
+  {
+    return *rewriter_;
+  }
+
+  const clang::Decl* reflected() const
+  {
+    return reflected_;
+  }
+
+private:
+  std::unique_ptr<clang::ASTUnit> ast_;
+  std::unique_ptr<clang::Rewriter> rewriter_;
+  const clang::Decl* reflected_ = nullptr;
+};
+
+StreamingReplacementSink::Options SpillOptions(
+  const base::FilePath& spillFile)
+{
+  StreamingReplacementSink::Options options;
+  options.spillThreshold = 20;
+  options.spillFile = spillFile;
+  return options;
+}
+
+// replaces declaration, inserts chunk after it and spills two chunks
+const StreamingReplacementSink::Report& StreamChunks(
+  StreamingReplacementSink& sink)
+{
+  EXPECT_TRUE(sink.Append("struct A {}"));
+  EXPECT_TRUE(sink.Append(";int b"));
+  EXPECT_TRUE(sink.Append("struct C {};"));
+  EXPECT_TRUE(sink.Append("int d;"));
+  return sink.Finish();
+}
+
+size_t CountFiles(
+  const base::FilePath& dir)
+{
+  size_t count = 0;
+  base::FileEnumerator enumerator(
+    dir, /*recursive*/ false, base::FileEnumerator::FILES);
+  for(base::FilePath path = enumerator.Next(); !path.empty();
+      path = enumerator.Next())
+  {
+    count++;
+  }
+  return count;
+}
+
+} // namespace
+
+TEST(StreamingReplacementSinkTest, ReplacesInsertsAfterAndSpills)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  const base::FilePath spillFile
+    = tempDir.GetPath().AppendASCII("spill").AppendASCII("main.inc");
+
+  RewrittenMainFile mainFile;
+  ASSERT_TRUE(mainFile.reflected());
+  // text inserted by other rule must survive replacement
+  mainFile.rewriter().InsertTextBefore(
+    mainFile.reflected()->getBeginLoc(), "/*other rule*/");
+
+  StreamingReplacementSink sink(
+    mainFile.rewriter(), mainFile.reflected(), SpillOptions(spillFile));
+  const StreamingReplacementSink::Report& report = StreamChunks(sink);
+
+  EXPECT_EQ(4u, report.chunks);
+  EXPECT_EQ(17u, report.bufferBytes);
+  EXPECT_EQ(18u, report.spilledBytes);
+  EXPECT_TRUE(report.spillFileChanged);
+
+  EXPECT_EQ(
+    "/*other rule*/struct A {};int b"
+    "\n#include \"" + spillFile.value() + "\"\n"
+    ";\n"
+    "int tail;\n"
+    , mainFile.Contents());
+
+  std::string spilled;
+  ASSERT_TRUE(base::ReadFileToString(spillFile, &spilled));
+  EXPECT_EQ("struct C {};int d;", spilled);
+  // temporary file renamed into spill file
+  EXPECT_EQ(1u, CountFiles(spillFile.DirName()));
+}
+
+TEST(StreamingReplacementSinkTest, KeepsUnchangedSpillFile)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  const base::FilePath spillFile = tempDir.GetPath().AppendASCII("main.inc");
+
+  {
+    RewrittenMainFile mainFile;
+    ASSERT_TRUE(mainFile.reflected());
+    StreamingReplacementSink sink(
+      mainFile.rewriter(), mainFile.reflected(), SpillOptions(spillFile));
+    EXPECT_TRUE(StreamChunks(sink).spillFileChanged);
+  }
+
+  const base::Time oldTime = base::Time::Now() - base::TimeDelta::FromHours(1);
+  ASSERT_TRUE(base::TouchFile(spillFile, oldTime, oldTime));
+  base::File::Info oldInfo;
+  ASSERT_TRUE(base::GetFileInfo(spillFile, &oldInfo));
+
+  RewrittenMainFile mainFile;
+  ASSERT_TRUE(mainFile.reflected());
+  StreamingReplacementSink sink(
+    mainFile.rewriter(), mainFile.reflected(), SpillOptions(spillFile));
+  EXPECT_FALSE(StreamChunks(sink).spillFileChanged);
+
+  base::File::Info newInfo;
+  ASSERT_TRUE(base::GetFileInfo(spillFile, &newInfo));
+  EXPECT_EQ(oldInfo.last_modified, newInfo.last_modified);
+  // temporary file removed
+  EXPECT_EQ(1u, CountFiles(spillFile.DirName()));
+}
+
+TEST(StreamingReplacementSinkTest, IncludesSpillFileByIncludeName)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  RewrittenMainFile mainFile;
+  ASSERT_TRUE(mainFile.reflected());
+
+  StreamingReplacementSink::Options options
+    = SpillOptions(tempDir.GetPath().AppendASCII("main.inc"));
+  options.includeName = "generated/main.inc";
+  StreamingReplacementSink sink(
+    mainFile.rewriter(), mainFile.reflected(), options);
+  EXPECT_FALSE(StreamChunks(sink).isFailed);
+  EXPECT_NE(std::string::npos, mainFile.Contents().find(
+    "\n#include \"generated/main.inc\"\n"));
+}
+
+TEST(StreamingReplacementSinkTest, FailsIfSpillFileCanNotBeIncluded)
+{
+  base::ScopedTempDir tempDir;
+  ASSERT_TRUE(tempDir.CreateUniqueTempDir());
+  const base::FilePath spillFile
+    = tempDir.GetPath().AppendASCII("main\".inc");
+  RewrittenMainFile mainFile;
+  ASSERT_TRUE(mainFile.reflected());
+
+  StreamingReplacementSink sink(
+    mainFile.rewriter(), mainFile.reflected(), SpillOptions(spillFile));
+  EXPECT_TRUE(sink.Append("struct A {}"));
+  EXPECT_TRUE(sink.Append(";int b"));
+  // spilled chunk is dropped, so sink fails
+  EXPECT_FALSE(sink.Append("struct C {};"));
+  EXPECT_FALSE(sink.Append("int d;"));
+  const StreamingReplacementSink::Report& report = sink.Finish();
+  EXPECT_TRUE(report.isFailed);
+  EXPECT_EQ(0u, report.spilledBytes);
+  EXPECT_EQ(std::string::npos, mainFile.Contents().find("#include"));
+  EXPECT_EQ(0u, CountFiles(tempDir.GetPath()));
+}
+
+TEST(StreamingReplacementSinkTest, KeepsOldCodeWithoutChunks)
+{
+  RewrittenMainFile mainFile;
+  ASSERT_TRUE(mainFile.reflected());
+  StreamingReplacementSink sink(mainFile.rewriter(), mainFile.reflected());
+  EXPECT_TRUE(sink.Append(""));
+  EXPECT_EQ(0u, sink.Finish().chunks);
+  EXPECT_EQ(kMainCode, mainFile.Contents());
+}
+
+} // namespace plugin
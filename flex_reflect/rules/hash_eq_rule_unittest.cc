@@ -0,0 +1,181 @@
+#include <flex_reflect_plugin/HashEqRule.hpp>
+
+#include "rule_test_util.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/command_line.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+namespace plugin {
+
+namespace hash_eq_runtime {
+
+// must match kRuntimeKeyCode,
+// members are generated by rule (checked by test)
+struct Name {
+  int value;
+  friend bool operator==(const Name& lhs, const Name& rhs) {
+    return lhs.value % 10 == rhs.value % 10;
+  }
+  friend std::size_t hash_value(const Name& name) {
+    return static_cast<std::size_t>(name.value % 10);
+  }
+};
+
+struct Key {
+  std::int32_t a;
+  std::int32_t b;
+  Name name;
+  std::int64_t c;
+  double weight;
+#include "data/rules/hash_eq_key_members.inc"
+};
+
+} // namespace hash_eq_runtime
+
+namespace {
+
+// fields that have no `std::hash` specialization
+const char kKeyCode[] =
+  "#include <cstddef>\n"
+  "#include <string>\n"
+  "#include <vector>\n"
+  "struct Name {\n"
+  "  std::string value;\n"
+  "  friend bool operator==(const Name& lhs, const Name& rhs) {\n"
+  "    return lhs.value == rhs.value;\n"
+  "  }\n"
+  "  friend std::size_t hash_value(const Name& name) {\n"
+  "    return name.value.size();\n"
+  "  }\n"
+  "};\n"
+  "struct Key {\n"
+  "  int id;\n"
+  "  std::vector<int> values;\n"
+  "  std::vector<std::vector<float>> matrix;\n"
+  "  Name name;\n"
+  "  std::vector<Name> aliases;\n"
+  "  double weight;\n"
+  "};\n"
+  "std::size_t useKey(const Key& key) {\n"
+  "  return Key::Hasher{}(key) + (key == key);\n"
+  "}\n";
+
+// field that can not be hashed,
+// generated `hash_value` is compiled even if not used
+const char kOpaqueCode[] =
+  "struct Opaque {\n"
+  "  float value;\n"
+  "  bool operator==(const Opaque& other) const {\n"
+  "    return value == other.value;\n"
+  "  }\n"
+  "};\n"
+  "struct Key {\n"
+  "  Opaque opaque;\n"
+  "};\n";
+
+// `Name` has unique object representation,
+// but must be compared by its operator
+const char kRuntimeKeyCode[] =
+  "#include <cstddef>\n"
+  "#include <cstdint>\n"
+  "struct Name {\n"
+  "  int value;\n"
+  "  friend bool operator==(const Name& lhs, const Name& rhs) {\n"
+  "    return lhs.value % 10 == rhs.value % 10;\n"
+  "  }\n"
+  "  friend std::size_t hash_value(const Name& name) {\n"
+  "    return static_cast<std::size_t>(name.value % 10);\n"
+  "  }\n"
+  "};\n"
+  "struct Key {\n"
+  "  std::int32_t a;\n"
+  "  std::int32_t b;\n"
+  "  Name name;\n"
+  "  std::int64_t c;\n"
+  "  double weight;\n"
+  "};\n";
+
+const char kTestDataDirSwitch[] = "test-data-dir";
+
+std::string ReadTestData(
+  const std::string& relativePath)
+{
+  const base::FilePath path
+    = base::CommandLine::ForCurrentProcess()
+        ->GetSwitchValuePath(kTestDataDirSwitch)
+        .AppendASCII(relativePath);
+  std::string contents;
+  EXPECT_TRUE(base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+} // namespace
+
+TEST(HashEqRuleTest, GeneratesRunsOfBytewiseFields)
+{
+  const std::string rewritten
+    = RunRuleOnRecord(kRuntimeKeyCode, "Key", &MakeHashEq);
+  // `a` and `b` share run at offset 0, `c` follows padding after `name`
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "std::addressof(rhs)) + 0, 8) == 0 /* a, b */"));
+  EXPECT_NE(std::string::npos, rewritten.find("lhs.name == rhs.name"));
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "std::addressof(rhs)) + 16, 8) == 0 /* c */"));
+  EXPECT_NE(std::string::npos, rewritten.find("lhs.weight == rhs.weight"));
+  // members compiled into this test
+  const std::string members
+    = ReadTestData("rules/hash_eq_key_members.inc");
+  ASSERT_FALSE(members.empty());
+  EXPECT_NE(std::string::npos, rewritten.find(members)) << rewritten;
+}
+
+TEST(HashEqRuleTest, GeneratedMembersKeepFieldOperators)
+{
+  using hash_eq_runtime::Key;
+  using hash_eq_runtime::Name;
+  const Key key{1, 2, Name{13}, 4, 0.5};
+  // equal by `Name::operator==`, not by bytes
+  const Key sameName{1, 2, Name{23}, 4, 0.5};
+  const Key otherB{1, 3, Name{13}, 4, 0.5};
+  const Key otherC{1, 2, Name{13}, 5, 0.5};
+  const Key otherWeight{1, 2, Name{13}, 4, 1.5};
+
+  EXPECT_TRUE(key == sameName);
+  EXPECT_EQ(hash_value(key), hash_value(sameName));
+  EXPECT_EQ(Key::Hasher{}(key), hash_value(key));
+  EXPECT_TRUE(key != otherB);
+  EXPECT_TRUE(key != otherC);
+  EXPECT_TRUE(key != otherWeight);
+  EXPECT_NE(hash_value(key), hash_value(otherB));
+}
+
+TEST(HashEqRuleTest, HashesFieldsWithoutStdHash)
+{
+  const std::string rewritten
+    = RunRuleOnRecord(kKeyCode, "Key", &MakeHashEq);
+  ASSERT_NE(kKeyCode, rewritten);
+  EXPECT_NE(std::string::npos, rewritten.find("friend std::size_t hash_value"));
+  EXPECT_TRUE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+TEST(HashEqRuleTest, RejectsUnhashableFieldAtCompileTime)
+{
+  const std::string rewritten
+    = RunRuleOnRecord(kOpaqueCode, "Key", &MakeHashEq);
+  ASSERT_NE(kOpaqueCode, rewritten);
+  EXPECT_TRUE(CompilesAsCpp17(kOpaqueCode));
+  EXPECT_FALSE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+} // namespace plugin
@@ -0,0 +1,107 @@
+#include <flex_reflect_plugin/PooledRule.hpp>
+
+#include "rule_test_util.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+const char kMessageCode[] =
+  "#include <new>\n"
+  "struct Message {\n"
+  "  int id;\n"
+  "  double value;\n"
+  "};\n"
+  "struct Derived : Message {\n"
+  "  char extra[40];\n"
+  "};\n"
+  "// frees pooled object after thread local cache may be destroyed\n"
+  "struct Holder {\n"
+  "  Message* message = new Message;\n"
+  "  ~Holder() { delete message; }\n"
+  "};\n"
+  "thread_local Holder holder;\n"
+  "void useMessage() {\n"
+  "  alignas(Message) unsigned char buffer[sizeof(Message)];\n"
+  "  Message* placed = new (buffer) Message;\n"
+  "  placed->~Message();\n"
+  "  delete new (std::nothrow) Message;\n"
+  "  delete new Derived;\n"
+  "  delete new (std::nothrow) Derived;\n"
+  "  (void)Message::poolStats();\n"
+  "}\n";
+
+const char kAlignedCode[] =
+  "#include <new>\n"
+  "struct alignas(64) Aligned {\n"
+  "  int id;\n"
+  "};\n"
+  "struct alignas(128) Derived : Aligned {\n"
+  "  int extra;\n"
+  "};\n"
+  "void useAligned() {\n"
+  "  delete new Aligned;\n"
+  "  delete new (std::nothrow) Aligned;\n"
+  "  delete new Derived;\n"
+  "}\n";
+
+} // namespace
+
+TEST(PooledRuleTest, KeepsPlacementAndNothrowNew)
+{
+  EXPECT_TRUE(CompilesAsCpp17(kMessageCode));
+  const std::string rewritten
+    = RunRuleOnRecord(kMessageCode, "Message", &MakePooled);
+  ASSERT_NE(kMessageCode, rewritten);
+  // size passed to operator delete is unknown when constructor throws
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "void* ptr, const std::nothrow_t&) noexcept {\n"
+    "    if(flexPoolOwns(ptr)) {"));
+  EXPECT_TRUE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+TEST(PooledRuleTest, FallsBackToSharedPoolAfterThreadCacheDestroyed)
+{
+  const std::string rewritten = RunRuleOnRecord(
+    kMessageCode, "Message", &MakePooled, "make_pooled(thread_cache=true)");
+  ASSERT_NE(kMessageCode, rewritten);
+  // cache is not accessed after its destruction
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "if(flexPoolCacheDestroyed()) {\n"
+    "      return nullptr;\n"
+    "    }\n"
+    "    static thread_local FlexPoolCache cache;"));
+  EXPECT_TRUE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+TEST(PooledRuleTest, RejectsInvalidThreadCacheValue)
+{
+  EXPECT_EQ(kMessageCode, RunRuleOnRecord(
+    kMessageCode, "Message", &MakePooled, "make_pooled(thread_cache=ture)"));
+  EXPECT_NE(kMessageCode, RunRuleOnRecord(
+    kMessageCode, "Message", &MakePooled, "make_pooled(thread_cache=false)"));
+}
+
+TEST(PooledRuleTest, CountsOnlySuccessfulAllocations)
+{
+  const std::string rewritten
+    = RunRuleOnRecord(kMessageCode, "Message", &MakePooled);
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "    void* ptr = flexPoolTake();\n"
+    "    if(ptr) {\n"
+    "      flexPoolState().allocations.fetch_add("));
+}
+
+TEST(PooledRuleTest, SupportsOverAlignedClass)
+{
+  const std::string rewritten = RunRuleOnRecord(
+    kAlignedCode, "Aligned", &MakePooled, "make_pooled(thread_cache=true)");
+  ASSERT_NE(kAlignedCode, rewritten);
+  EXPECT_TRUE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+} // namespace plugin
@@ -0,0 +1,166 @@
+#include <flex_reflect_plugin/RuleChain.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/bind.h>
+#include <base/synchronization/lock.h>
+#include <base/threading/simple_thread.h>
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+// models rewriter: applied results are appended to |text|,
+// non-pure rule returns text it observed
+struct ChainState {
+  base::Lock lock;
+
+  std::string text;
+
+  std::vector<std::string> results;
+
+  // order in which rules ran and results were applied
+  std::vector<std::string> events;
+
+  int concurrentRuns = 0;
+};
+
+struct RuleSpec {
+  const char* name;
+
+  bool isPure;
+};
+
+void RunRule(
+  ChainState* state
+  , size_t index
+  , const char* name
+  , bool isPure)
+{
+  base::AutoLock lock(state->lock);
+  state->events.push_back(std::string("run ") + name);
+  state->results[index] = isPure
+    ? std::string(name)
+    : std::string(name) + "(" + state->text + ")";
+}
+
+void ApplyResult(
+  ChainState* state
+  , size_t index)
+{
+  base::AutoLock lock(state->lock);
+  state->events.push_back("apply " + state->results[index]);
+  state->text += state->results[index] + ";";
+}
+
+void CountConcurrentRun(
+  ChainState* state)
+{
+  base::AutoLock lock(state->lock);
+  state->concurrentRuns++;
+}
+
+// applies result of each rule right after it ran
+std::string RunBaseline(
+  const std::vector<RuleSpec>& rules)
+{
+  ChainState state;
+  state.results.resize(rules.size());
+  for(size_t i = 0; i < rules.size(); i++) {
+    RunRule(&state, i, rules[i].name, rules[i].isPure);
+    ApplyResult(&state, i);
+  }
+  return state.text;
+}
+
+std::string RunChain(
+  const std::vector<RuleSpec>& rules
+  , base::DelegateSimpleThreadPool* pool
+  , int* concurrentRuns
+  , std::vector<std::string>* events = nullptr)
+{
+  ChainState state;
+  state.results.resize(rules.size());
+
+  RuleChain chain(pool);
+  for(size_t i = 0; i < rules.size(); i++) {
+    RuleChain::Step step;
+    step.runRule = base::BindRepeating(
+      &RunRule, base::Unretained(&state), i
+      , rules[i].name, rules[i].isPure);
+    step.applyResult = base::BindOnce(
+      &ApplyResult, base::Unretained(&state), i);
+    step.isPure = rules[i].isPure;
+    chain.AddStep(std::move(step));
+  }
+  chain.Run(base::BindRepeating(
+    &CountConcurrentRun, base::Unretained(&state)));
+
+  *concurrentRuns = state.concurrentRuns;
+  if(events) {
+    *events = state.events;
+  }
+  return state.text;
+}
+
+const std::vector<RuleSpec> kMixedChain{
+  {"pure_a", true}
+  , {"pure_b", true}
+  , {"rewrite_c", false}
+  , {"pure_d", true}
+  , {"rewrite_e", false}
+  , {"pure_f", true}
+  , {"pure_g", true}
+  , {"pure_h", true}
+  , {"rewrite_i", false}
+};
+
+} // namespace
+
+TEST(RuleChainTest, SerialChainMatchesBaseline)
+{
+  int concurrentRuns = 0;
+  EXPECT_EQ(RunBaseline(kMixedChain)
+            , RunChain(kMixedChain, nullptr, &concurrentRuns));
+  EXPECT_EQ(0, concurrentRuns);
+  EXPECT_EQ("pure_a;pure_b;rewrite_c(pure_a;pure_b;);pure_d;"
+            "rewrite_e(pure_a;pure_b;rewrite_c(pure_a;pure_b;);pure_d;);"
+            "pure_f;pure_g;pure_h;"
+            "rewrite_i(pure_a;pure_b;rewrite_c(pure_a;pure_b;);pure_d;"
+            "rewrite_e(pure_a;pure_b;rewrite_c(pure_a;pure_b;);pure_d;);"
+            "pure_f;pure_g;pure_h;);"
+            , RunBaseline(kMixedChain));
+}
+
+TEST(RuleChainTest, SerialChainAppliesResultBeforeNextRule)
+{
+  int concurrentRuns = 0;
+  std::vector<std::string> events;
+  RunChain({{"pure_a", true}, {"pure_b", true}, {"rewrite_c", false}}
+           , nullptr, &concurrentRuns, &events);
+  EXPECT_EQ((std::vector<std::string>{
+              "run pure_a", "apply pure_a"
+              , "run pure_b", "apply pure_b"
+              , "run rewrite_c", "apply rewrite_c(pure_a;pure_b;)"})
+            , events);
+}
+
+TEST(RuleChainTest, ConcurrentChainMatchesBaseline)
+{
+  base::DelegateSimpleThreadPool pool("RuleChainTest", 3);
+  pool.Start();
+
+  int concurrentRuns = 0;
+  EXPECT_EQ(RunBaseline(kMixedChain)
+            , RunChain(kMixedChain, &pool, &concurrentRuns));
+  // groups `pure_a, pure_b` and `pure_f, pure_g, pure_h`
+  EXPECT_EQ(2, concurrentRuns);
+
+  pool.JoinAll();
+}
+
+} // namespace plugin
@@ -0,0 +1,93 @@
+#include "rule_test_util.h"
+
+#include <flexlib/funcParser.hpp>
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/ASTMatchers/ASTMatchFinder.h>
+#include <clang/ASTMatchers/ASTMatchers.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/FrontendActions.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <memory>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+const char kRecordBinding[] = "record";
+
+const char kMainFile[] = "/src/main.cpp";
+
+} // namespace
+
+std::string RunRuleOnRecord(
+  const std::string& code
+  , const std::string& recordName
+  , SourceTransformRule rule
+  , const std::string& funcWithArgs)
+{
+  std::unique_ptr<clang::ASTUnit> ast
+    = clang::tooling::buildASTFromCodeWithArgs(
+        code, {"-std=c++17"}, kMainFile);
+  if(!ast) {
+    ADD_FAILURE() << "unable to parse code";
+    return code;
+  }
+
+  using namespace clang::ast_matchers;
+  clang::ASTContext& context = ast->getASTContext();
+  const clang::CXXRecordDecl* record
+    = selectFirst<clang::CXXRecordDecl>(
+        kRecordBinding
+        , match(
+            cxxRecordDecl(hasName(recordName), isDefinition())
+              .bind(kRecordBinding)
+            , context));
+  if(!record) {
+    ADD_FAILURE() << "record is not defined: " << recordName;
+    return code;
+  }
+
+  clang::Rewriter rewriter(ast->getSourceManager(), ast->getLangOpts());
+  // arguments are parsed like in `ReflectTooling::callFuncBySignature`
+  std::vector<::flexlib::parsed_func> funcs;
+  if(!funcWithArgs.empty()) {
+    funcs = ::flexlib::split_to_funcs(funcWithArgs + ";");
+  }
+  if(funcs.empty()) {
+    funcs.emplace_back();
+  }
+  const ::flexlib::parsed_func& func = funcs.front();
+  const clang_utils::MatchResult matchResult(BoundNodes{}, &context);
+  rule(clang_utils::SourceTransformOptions{
+    func
+    , matchResult
+    , rewriter
+    , record
+    , funcs
+  });
+
+  const clang::RewriteBuffer* buffer = rewriter.getRewriteBufferFor(
+    ast->getSourceManager().getMainFileID());
+  return buffer
+    ? std::string(buffer->begin(), buffer->end())
+    : code;
+}
+
+bool CompilesAsCpp17(
+  const std::string& code)
+{
+  return clang::tooling::runToolOnCodeWithArgs(
+    std::make_unique<clang::SyntaxOnlyAction>()
+    , code
+    , {"-std=c++17"}
+    , kMainFile);
+}
+
+} // namespace plugin
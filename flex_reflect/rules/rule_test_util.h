@@ -0,0 +1,26 @@
+#pragma once
+
+#include <flexlib/clangPipeline.hpp>
+
+#include <string>
+
+namespace plugin {
+
+using SourceTransformRule = clang_utils::SourceTransformResult (*)(
+  const clang_utils::SourceTransformOptions&);
+
+// parses |code| as C++17, runs |rule| on definition of record |recordName|
+// and returns rewritten code (unchanged code if rule did not edit it),
+// |funcWithArgs| is call of rule in annotation (like `make_a(x=1)`),
+// its arguments are parsed by `flexlib::split_to_funcs`
+std::string RunRuleOnRecord(
+  const std::string& code
+  , const std::string& recordName
+  , SourceTransformRule rule
+  , const std::string& funcWithArgs = std::string{});
+
+// returns true if |code| compiles as C++17
+bool CompilesAsCpp17(
+  const std::string& code);
+
+} // namespace plugin
@@ -0,0 +1,162 @@
+#include <flex_reflect_plugin/VisitorRule.hpp>
+
+#include "rule_test_util.h"
+
+#include "testing/gtest/include/gtest/gtest.h"
+
+#include <base/command_line.h>
+#include <base/files/file_path.h>
+#include <base/files/file_util.h>
+
+#include <string>
+#include <utility>
+
+// must match kRuntimeNodeCode,
+// hierarchy is generated by rule (checked by test)
+#include "data/rules/visitor_node_hierarchy.inc"
+
+namespace plugin {
+
+namespace {
+
+const char kNodeCode[] =
+  "struct Node {\n"
+  "  virtual ~Node() = default;\n"
+  "};\n"
+  "struct Add : Node {\n"
+  "  int lhs, rhs;\n"
+  "};\n"
+  "struct Mul : Node {\n"
+  "  long factor;\n"
+  "};\n";
+
+// visits objects after hierarchy
+const char kVisitCode[] =
+  "unsigned long sizeOfDynamicType(const Node& node) {\n"
+  "  return node.flexVisit([](const auto& concrete) {\n"
+  "    return (unsigned long)sizeof(concrete);\n"
+  "  });\n"
+  "}\n";
+
+// class with dependent base is not found by rule
+const char kMissedClassCode[] =
+  "template <typename Base>\n"
+  "struct Wrapper : Base {};\n"
+  "Wrapper<Node> wrapper;\n";
+
+// hierarchy compiled into this test
+const char kRuntimeNodeCode[] =
+  "#include <utility>\n"
+  "namespace visitor_runtime {\n"
+  "struct Node {\n"
+  "  virtual ~Node() = default;\n"
+  "};\n"
+  "struct Add : Node {\n"
+  "  int lhs, rhs;\n"
+  "};\n"
+  "struct Mul : Node {\n"
+  "  long factor;\n"
+  "};\n"
+  "} // namespace visitor_runtime\n";
+
+// overloads for const and non-const objects return different names
+struct NameVisitor {
+  std::string operator()(visitor_runtime::Add& add) const {
+    return "Add " + std::to_string(add.lhs + add.rhs);
+  }
+
+  std::string operator()(visitor_runtime::Mul& mul) const {
+    mul.factor *= 2;
+    return "Mul";
+  }
+
+  std::string operator()(const visitor_runtime::Add&) const {
+    return "const Add";
+  }
+
+  std::string operator()(const visitor_runtime::Mul&) const {
+    return "const Mul";
+  }
+};
+
+const char kTestDataDirSwitch[] = "test-data-dir";
+
+std::string ReadTestData(
+  const std::string& relativePath)
+{
+  const base::FilePath path
+    = base::CommandLine::ForCurrentProcess()
+        ->GetSwitchValuePath(kTestDataDirSwitch)
+        .AppendASCII(relativePath);
+  std::string contents;
+  EXPECT_TRUE(base::ReadFileToString(path, &contents)) << path;
+  return contents;
+}
+
+const char kDerivedTemplateCode[] =
+  "template <typename T>\n"
+  "struct Constant : Node {\n"
+  "  T value;\n"
+  "};\n";
+
+} // namespace
+
+TEST(VisitorRuleTest, DispatchesToConcreteClasses)
+{
+  const std::string rewritten
+    = RunRuleOnRecord(kNodeCode, "Node", &MakeVisitor);
+  ASSERT_NE(kNodeCode, rewritten);
+  EXPECT_NE(std::string::npos, rewritten.find(
+    "virtual unsigned flexVisitorTypeId() const noexcept = 0;"));
+  EXPECT_TRUE(CompilesAsCpp17(rewritten + kVisitCode)) << rewritten;
+}
+
+TEST(VisitorRuleTest, MissedConcreteClassFailsToCompile)
+{
+  const std::string code = std::string(kNodeCode) + kMissedClassCode;
+  EXPECT_TRUE(CompilesAsCpp17(code));
+  const std::string rewritten
+    = RunRuleOnRecord(code, "Node", &MakeVisitor);
+  ASSERT_NE(code, rewritten);
+  // `Node` became abstract and `Wrapper<Node>` has no type id
+  EXPECT_FALSE(CompilesAsCpp17(rewritten)) << rewritten;
+}
+
+TEST(VisitorRuleTest, ReportsDerivedClassTemplate)
+{
+  const std::string code = std::string(kNodeCode) + kDerivedTemplateCode;
+  EXPECT_TRUE(CompilesAsCpp17(code));
+  EXPECT_EQ(code, RunRuleOnRecord(code, "Node", &MakeVisitor));
+}
+
+TEST(VisitorRuleTest, GeneratesHierarchyCompiledIntoTest)
+{
+  const std::string hierarchy
+    = ReadTestData("rules/visitor_node_hierarchy.inc");
+  ASSERT_FALSE(hierarchy.empty());
+  EXPECT_EQ("#include <utility>\n" + hierarchy
+            , RunRuleOnRecord(kRuntimeNodeCode, "Node", &MakeVisitor));
+}
+
+TEST(VisitorRuleTest, VisitsDynamicTypeOfBaseReference)
+{
+  visitor_runtime::Add add;
+  add.lhs = 1;
+  add.rhs = 2;
+  visitor_runtime::Mul mul;
+  mul.factor = 3;
+
+  visitor_runtime::Node& addNode = add;
+  visitor_runtime::Node& mulNode = mul;
+  EXPECT_EQ("Add 3", addNode.flexVisit(NameVisitor{}));
+  EXPECT_EQ("Mul", mulNode.flexVisit(NameVisitor{}));
+  // non-const overload gets mutable object
+  EXPECT_EQ(6, mul.factor);
+
+  const visitor_runtime::Node& constAddNode = add;
+  const visitor_runtime::Node& constMulNode = mul;
+  EXPECT_EQ("const Add", constAddNode.flexVisit(NameVisitor{}));
+  EXPECT_EQ("const Mul", constMulNode.flexVisit(NameVisitor{}));
+}
+
+} // namespace plugin
@@ -0,0 +1,28 @@
+﻿#pragma once
+
+namespace plugin {
+
+// prefix of annotations processed by flextool plugins
+constexpr char kGenPrefix[] = "{gen};";
+
+// tokens of annotation methods registered by
+// `FlexReflectEventHandler::RegisterAnnotationMethods`
+constexpr char kExecuteCodeMethod[] = "{executeCode};";
+
+constexpr char kExecuteCodeAndReplaceMethod[]
+  = "{executeCodeAndReplace};";
+
+constexpr char kExecuteCodeAndEditMethod[]
+  = "{executeCodeAndEdit};";
+
+constexpr char kFunccallMethod[] = "{funccall};";
+
+// all tokens of annotation methods
+constexpr const char* kAnnotationMethods[] = {
+  kExecuteCodeMethod
+  , kExecuteCodeAndReplaceMethod
+  , kExecuteCodeAndEditMethod
+  , kFunccallMethod
+};
+
+} // namespace plugin
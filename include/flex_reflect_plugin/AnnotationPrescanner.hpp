@@ -0,0 +1,98 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/strings/string_piece.h>
+
+#include <clang/Basic/SourceLocation.h>
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace clang {
+class Decl;
+class SourceManager;
+} // namespace clang
+
+namespace plugin {
+
+/// \note searches raw bytes of files for tokens of annotation methods
+/// (like `{funccall};`), so AST of files without annotations
+/// is not traversed by plugin.
+/// Each file is memory mapped and scanned once per process.
+/// \note annotation hidden in macro defined in other file
+/// is not found by prescan.
+/// \note only traversals enabled by `prescan_annotations`
+/// (prevalidation of snippets and header cache) skip files,
+/// matching of annotations by flextool is not affected.
+class AnnotationPrescanner {
+public:
+  explicit AnnotationPrescanner(
+    const std::vector<std::string>& tokens);
+
+  ~AnnotationPrescanner();
+
+  // returns true if |data| contains any token
+  static bool ContainsAnyToken(
+    base::StringPiece data
+    , const std::vector<std::string>& tokens);
+
+  // returns false only if file exists and contains no tokens
+  bool MayContainAnnotations(
+    const base::FilePath& path);
+
+  // logs amount of scanned and skipped files
+  void LogStats() const;
+
+private:
+  std::vector<std::string> tokens_;
+
+  // file path to prescan result
+  std::map<base::FilePath, bool> scannedFiles_;
+
+  size_t filesWithAnnotations_ = 0;
+
+  size_t skippedFiles_ = 0;
+
+  size_t failedFiles_ = 0;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(AnnotationPrescanner);
+};
+
+// decides which declarations of translation unit must be traversed
+// based on prescan of files with these declarations
+class TranslationUnitFileFilter {
+public:
+  // |prescanner| may be nullptr, then all declarations are traversed
+  TranslationUnitFileFilter(
+    AnnotationPrescanner* prescanner
+    , const clang::SourceManager& sourceManager);
+
+  ~TranslationUnitFileFilter();
+
+  bool ShouldTraverse(
+    const clang::Decl* decl);
+
+  size_t skippedDecls() const
+  {
+    return skippedDecls_;
+  }
+
+private:
+  AnnotationPrescanner* prescanner_;
+
+  const clang::SourceManager& sourceManager_;
+
+  // prescan results of files of translation unit
+  std::map<clang::FileID, bool> fileResults_;
+
+  size_t skippedDecls_ = 0;
+
+  DISALLOW_COPY_AND_ASSIGN(TranslationUnitFileFilter);
+};
+
+} // namespace plugin
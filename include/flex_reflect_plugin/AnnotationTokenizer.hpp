@@ -0,0 +1,59 @@
+﻿#pragma once
+
+#include <base/strings/string_piece.h>
+
+#include <cstdint>
+#include <vector>
+
+namespace plugin {
+
+// instruction set used to find delimiters
+enum class DelimiterScanner {
+  kScalar
+  , kSse42
+  , kAvx2
+};
+
+// best scanner supported by CPU
+DelimiterScanner DefaultDelimiterScanner();
+
+// returns true for bytes that separate parts of `funccall` annotation:
+// `;`, `(`, `)`, `,`, `=` and `"`
+bool IsAnnotationDelimiter(char c);
+
+// appends offsets of all delimiters of |text| to |offsets|.
+/// \note |scanner| must be supported by CPU
+void FindAnnotationDelimiters(
+  DelimiterScanner scanner
+  , base::StringPiece text
+  , std::vector<uint32_t>* offsets);
+
+struct AnnotationArg {
+  // empty if argument has no `name=`
+  base::StringPiece name;
+
+  base::StringPiece value;
+};
+
+struct AnnotationCall {
+  // call without trailing `;`
+  base::StringPiece text;
+
+  base::StringPiece name;
+
+  std::vector<AnnotationArg> args;
+};
+
+/// \note splits `funccall` annotation like `make_a;make_b(x=1, "y");`
+/// into calls using delimiters found by |scanner|.
+/// Returned views point into |annotation| (nothing is copied),
+/// delimiters inside quotes are ignored, calls with empty name are skipped.
+/// \note benchmark only (see `annotation_tokenizer_perftest.cc`),
+/// plugin does not use it: rules receive arguments
+/// in `flexlib::parsed_func` of `flexlib::split_to_funcs`,
+/// and separate pre-pass could disagree with it about called rules.
+std::vector<AnnotationCall> TokenizeAnnotation(
+  base::StringPiece annotation
+  , DelimiterScanner scanner = DefaultDelimiterScanner());
+
+} // namespace plugin
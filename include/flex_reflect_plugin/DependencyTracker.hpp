@@ -0,0 +1,108 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/strings/string_piece.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+class Decl;
+class SourceManager;
+class SourceLocation;
+} // namespace clang
+
+namespace plugin {
+
+// path to file that contains expansion of |loc|,
+// empty if |loc| does not belong to file (macro scratch space etc.)
+base::FilePath FilePathOfLocation(
+  const clang::SourceManager& sourceManager
+  , clang::SourceLocation loc);
+
+// escapes path for Makefile/Ninja depfile syntax
+std::string EscapeDepfilePath(
+  const base::FilePath& path);
+
+// header named by `#include` directive of interpreted code
+struct SnippetInclude {
+  std::string name;
+
+  // `#include "name"` (otherwise `#include <name>`)
+  bool isQuoted = false;
+};
+
+// finds `#include` directives in |snippet|,
+// directives with macro as argument are ignored
+std::vector<SnippetInclude> ParseSnippetIncludes(
+  base::StringPiece snippet);
+
+// collects file that contains |nodeDecl|
+// and headers of types referenced by |nodeDecl|
+void CollectDeclDependencies(
+  const clang::SourceManager& sourceManager
+  , const clang::Decl* nodeDecl
+  , std::set<base::FilePath>* files);
+
+/// \note collects files consulted while processing annotations
+/// in each source file, so build system can regenerate
+/// only affected files (see `WriteDepfile`)
+class DependencyTracker {
+public:
+  DependencyTracker();
+
+  ~DependencyTracker();
+
+  // remembers files of translation unit,
+  // used to resolve `#include` directives of interpreted code
+  void ResetTranslationUnit(
+    const clang::SourceManager& sourceManager);
+
+  // remembers file that contains |nodeDecl|
+  // and headers of types referenced by |nodeDecl|
+  void AddDeclDependencies(
+    const base::FilePath& sourceFile
+    , const clang::SourceManager& sourceManager
+    , const clang::Decl* nodeDecl);
+
+  // remembers headers included by interpreted code
+  void AddSnippetIncludes(
+    const base::FilePath& sourceFile
+    , base::StringPiece snippet);
+
+  // remembers already collected dependencies of |sourceFile|
+  void AddDependencies(
+    const base::FilePath& sourceFile
+    , const std::set<base::FilePath>& dependencies);
+
+  // remembers file (rule library etc.) for all source files
+  void AddCommonDependency(
+    const base::FilePath& dependency);
+
+  // returns Makefile/Ninja compatible rule
+  // `target: dependencies of sourceFile`
+  std::string FormatDepfile(
+    const base::FilePath& sourceFile
+    , const base::FilePath& target) const;
+
+  void Clear();
+
+private:
+  // source file to files consulted while processing it
+  std::map<base::FilePath, std::set<base::FilePath>> dependencies_;
+
+  std::set<base::FilePath> commonDependencies_;
+
+  // files of current translation unit
+  std::set<base::FilePath> translationUnitFiles_;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(DependencyTracker);
+};
+
+} // namespace plugin
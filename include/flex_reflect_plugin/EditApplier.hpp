@@ -0,0 +1,29 @@
+﻿#pragma once
+
+#include <flex_reflect_plugin/ReflectEdits.hpp>
+
+#include <base/strings/string_piece.h>
+
+namespace clang {
+class Decl;
+class Rewriter;
+} // namespace clang
+
+namespace plugin {
+
+// applies |edits| relative to |nodeDecl| in order of declaration
+void ApplyReflectEdits(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , const ReflectEdits& edits);
+
+// adds `#include |header|` at top of file with |nodeDecl|
+// if preprocessor did not include |header| into that file
+// and previous edits did not add it,
+// |header| is `<header>` or `"header"` (both forms match)
+void AddIncludeOnce(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , base::StringPiece header);
+
+} // namespace plugin
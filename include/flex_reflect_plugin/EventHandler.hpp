@@ -1,6 +1,8 @@
 ﻿#pragma once
 
+#include <flex_reflect_plugin/Settings.hpp>
 #include <flex_reflect_plugin/Tooling.hpp>
+#include <flex_reflect_plugin/TraceRecorder.hpp>
 
 #include <flexlib/ToolPlugin.hpp>
 #if defined(CLING_IS_ON)
@@ -10,13 +12,16 @@
 #include <base/logging.h>
 #include <base/sequenced_task_runner.h>
 
+#include <memory>
+
 namespace plugin {
 
 /// \note class name must not collide with
 /// class names from other loaded plugins
 class FlexReflectEventHandler {
 public:
-  FlexReflectEventHandler();
+  explicit FlexReflectEventHandler(
+    const FlexReflectSettings& settings);
 
   ~FlexReflectEventHandler();
 
@@ -32,10 +37,28 @@ public:
     const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event);
 
 private:
+#if defined(CLING_IS_ON)
+  // returns interpreter registered by host application
+  // or creates interpreter of plugin on first call
+  ::cling_utils::ClingInterpreter* clingInterpreter();
+#endif // CLING_IS_ON
+
+private:
+  FlexReflectSettings settings_;
+
   std::unique_ptr<ReflectTooling> tooling_;
 
+  // controlled by `/trace start|stop <path>` command
+  TraceRecorder traceRecorder_;
+
 #if defined(CLING_IS_ON)
-  ::cling_utils::ClingInterpreter* clingInterpreter_;
+  // registered by host application,
+  // may stay null if interpreted code is never executed
+  ::cling_utils::ClingInterpreter* clingInterpreter_ = nullptr;
+
+  // created only when interpreted code must be executed
+  // and host application did not register interpreter
+  std::unique_ptr<::cling_utils::ClingInterpreter> ownClingInterpreter_;
 #endif // CLING_IS_ON
 
   SEQUENCE_CHECKER(sequence_checker_);
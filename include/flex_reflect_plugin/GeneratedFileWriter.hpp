@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/strings/string_piece.h>
+
+#include <string>
+
+namespace plugin {
+
+// hex-encoded SHA1 of |data|
+std::string ContentHash(
+  base::StringPiece data);
+
+// "main.cpp" becomes "main.cpp.generated.cpp".
+// path of |sourceFile| relative to |sourceRoot| is kept
+// (`a/foo.hpp` and `b/foo.hpp` do not overwrite each other),
+// files outside of |sourceRoot| are stored using their absolute path
+// in `_external` subdirectory of |outputDir|.
+/// \note |sourceRoot| and |sourceFile| must be absolute
+/// and normalized (see `base::MakeAbsoluteFilePath`)
+base::FilePath GeneratedFilePath(
+  const base::FilePath& outputDir
+  , const base::FilePath& sourceRoot
+  , const base::FilePath& sourceFile);
+
+/// \note writes generated file only if its contents changed,
+/// so unchanged files keep their modification time
+/// and dependent objects are not recompiled.
+class GeneratedFileWriter {
+public:
+  // |statsName| describes written files in logged stats
+  // ("generated files", "depfiles" etc.)
+  explicit GeneratedFileWriter(
+    const std::string& statsName);
+
+  ~GeneratedFileWriter();
+
+  // returns false if file can not be written
+  bool WriteIfChanged(
+    const base::FilePath& path
+    , base::StringPiece contents);
+
+  // moves already written |tempFile| to |path| if contents differ,
+  // otherwise deletes |tempFile|.
+  /// \note |tempFile| must be on same file system as |path|
+  /// (rename is atomic), contents are compared without copying them
+  /// into memory, so file may be larger than available memory
+  bool ReplaceIfChanged(
+    const base::FilePath& tempFile
+    , const base::FilePath& path);
+
+  // logs amount of written and skipped (unchanged) files
+  void LogStats() const;
+
+  size_t writtenFiles() const
+  {
+    return writtenFiles_;
+  }
+
+  size_t skippedFiles() const
+  {
+    return skippedFiles_;
+  }
+
+private:
+  const std::string statsName_;
+
+  size_t writtenFiles_ = 0;
+
+  size_t skippedFiles_ = 0;
+
+  size_t failedFiles_ = 0;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(GeneratedFileWriter);
+};
+
+} // namespace plugin
@@ -0,0 +1,36 @@
+﻿#pragma once
+
+#include <flexlib/clangPipeline.hpp>
+
+namespace plugin {
+
+// name of rule used in `{funccall};make_hash_eq;` annotation
+extern const char kMakeHashEqRule[];
+
+/// \note generates hidden friends `operator==`, `operator!=`,
+/// `hash_value` and nested `Hasher` for annotated record.
+/// Contiguous runs of fields without padding that can be compared
+/// bytewise (`ASTContext::hasUniqueObjectRepresentations`)
+/// are compared using single `memcmp` and hashed word by word,
+/// other fields are compared and hashed one by one.
+/// Fields of record types with user declared `operator==`
+/// or `hash_value` (also in their fields) are never compared bytewise.
+/// Field is hashed with `hash_value` found by ADL
+/// (customization point, also generated by this rule),
+/// otherwise with `std::hash`,
+/// otherwise element by element (`std::vector` etc.),
+/// other field types are rejected by `static_assert`.
+/// Records with base classes are not supported.
+/// EXAMPLE:
+///   struct
+///     __attribute__((annotate("{gen};{funccall};make_hash_eq;")))
+///   Key {
+///     int32_t a;
+///     int32_t b;
+///     std::string name;
+///   };
+///   std::unordered_map<Key, int, Key::Hasher> map;
+clang_utils::SourceTransformResult MakeHashEq(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions);
+
+} // namespace plugin
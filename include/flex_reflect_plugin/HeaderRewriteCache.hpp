@@ -0,0 +1,141 @@
+﻿#pragma once
+
+#include <clang/Basic/SourceLocation.h>
+
+#include <base/callback.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/optional.h>
+#include <base/sequence_checker.h>
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace clang {
+class ASTContext;
+class Rewriter;
+} // namespace clang
+
+namespace plugin {
+
+class AnnotationPrescanner;
+
+// signature of rewrite buffer of each edited file,
+// signature changes if file is edited.
+/// \note made from text pieces of buffers, so text is not copied
+std::map<clang::FileID, size_t> RewriteBufferSignatures(
+  const clang::Rewriter& rewriter);
+
+// detects annotation methods that must prevent caching of headers.
+// header of annotation is not cached if method failed
+// (`MarkSucceeded` not called) or edited other files,
+// header edited by annotation of other file is not cached too
+class ScopedHeaderCacheCheck {
+public:
+  // called with files that must not be cached
+  using DisableCacheCallback
+    = base::RepeatingCallback<void(clang::FileID)>;
+
+  ScopedHeaderCacheCheck(
+    const clang::Rewriter& rewriter
+    , clang::FileID annotatedFile
+    , DisableCacheCallback disableCache);
+
+  ~ScopedHeaderCacheCheck();
+
+  void MarkSucceeded()
+  {
+    succeeded_ = true;
+  }
+
+private:
+  const clang::Rewriter& rewriter_;
+
+  const clang::FileID annotatedFile_;
+
+  // signatures of files before annotation method
+  const std::map<clang::FileID, size_t> signatures_;
+
+  DisableCacheCallback disableCache_;
+
+  bool succeeded_ = false;
+
+  DISALLOW_COPY_AND_ASSIGN(ScopedHeaderCacheCheck);
+};
+
+/// \note stores rewritten contents of annotated headers,
+/// so headers included by many translation units
+/// are processed only once per build.
+/// Key is made from header path, header contents,
+/// annotations of header, set of registered rules
+/// and preprocessor state that affects header
+/// (predefined and command line macros,
+/// definitions of macros expanded in header
+/// and declarations produced by header).
+/// \note header is cached only if processing of its annotations
+/// succeeded and edited only header itself
+/// (see `ScopedHeaderCacheCheck`),
+/// edits of other files would be lost when header restored from cache.
+/// \note cache entries are written atomically (rename of temporary file),
+/// so cache can be shared by concurrent processes.
+/// \note only headers with `funccall` annotations are cached,
+/// headers with interpreted code (`executeCode`,
+/// `executeCodeAndReplace`, `executeCodeAndEdit`) are never cached,
+/// because executed code may change state of interpreter
+/// used by other annotations
+class HeaderRewriteCache {
+public:
+  struct HeaderKey {
+    std::string key;
+
+    // files consulted while processing annotations of header
+    std::set<base::FilePath> dependencies;
+  };
+
+  explicit HeaderRewriteCache(
+    const base::FilePath& cacheDir);
+
+  ~HeaderRewriteCache();
+
+  // computes keys of annotated headers of translation unit
+  // (main file is never cached),
+  // |ruleSet| describes registered annotation methods and rules,
+  // |prescanner| (may be nullptr) excludes files without annotations
+  std::map<base::FilePath, HeaderKey> ComputeHeaderKeys(
+    clang::ASTContext& context
+    , const std::string& ruleSet
+    , AnnotationPrescanner* prescanner) const;
+
+  // returns false on cache miss.
+  // |contents| is set to null if annotations did not rewrite header
+  bool Lookup(
+    const std::string& key
+    , base::Optional<std::string>* contents);
+
+  // |contents| is null if annotations did not rewrite header
+  void Store(
+    const std::string& key
+    , const base::Optional<std::string>& contents);
+
+  // logs amount of cache hits and misses
+  void LogStats() const;
+
+private:
+  base::FilePath entryPath(
+    const std::string& key
+    , const char* extension) const;
+
+private:
+  base::FilePath cacheDir_;
+
+  size_t hits_ = 0;
+
+  size_t misses_ = 0;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(HeaderRewriteCache);
+};
+
+} // namespace plugin
@@ -0,0 +1,33 @@
+﻿#pragma once
+
+#include <flexlib/clangPipeline.hpp>
+
+namespace plugin {
+
+// name of rule used in `{funccall};make_pooled;` annotation
+extern const char kMakePooledRule[];
+
+/// \note generates class-specific `operator new` and `operator delete`
+/// that allocate objects of annotated class from slabs of slots
+/// with exact size of class, freed objects are kept in freelist.
+/// Allocations of other size (derived classes) use global allocator.
+/// Aligned, nothrow and placement forms of `operator new`
+/// (hidden by class-specific operator) are generated too.
+/// Nothrow `operator new` returns nullptr if slab can not be allocated.
+/// Objects freed after thread local cache of exiting thread
+/// was destroyed are returned to shared freelist.
+/// Optional arguments:
+///   slab_objects - objects per slab (256 by default)
+///   thread_cache - `true` to keep freed objects in thread local cache
+///   thread_cache_objects - limit of thread local cache (64 by default)
+/// Generated `poolStats()` returns allocation counters.
+/// EXAMPLE:
+///   class
+///     __attribute__((annotate("{gen};{funccall};make_pooled(thread_cache=true);")))
+///   Message {
+///     ...
+///   };
+clang_utils::SourceTransformResult MakePooled(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions);
+
+} // namespace plugin
@@ -0,0 +1,81 @@
+﻿#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+/// \note header is used both by plugin and by code
+/// interpreted in Cling C++ interpreter,
+/// so it must depend only on standard library
+/// and must stay header-only.
+
+namespace plugin {
+
+struct ReflectEdit {
+  enum class Kind {
+    // insert text before annotated declaration
+    kInsertBefore
+    // insert text after annotated declaration
+    , kInsertAfter
+    // replace annotated declaration with text
+    , kReplace
+    // add `#include` at top of file with annotated declaration
+    // (text is `<header>` or `"header"`),
+    // include is not added if file already includes header
+    , kAddInclude
+    // append text to end of file with annotated declaration
+    , kAppendToFile
+  };
+
+  Kind kind;
+
+  std::string text;
+};
+
+/// \note returned by code of `executeCodeAndEdit` annotation,
+/// edits are applied in order of declaration
+/// EXAMPLE:
+///   new plugin::ReflectEdits{plugin::ReflectEdits{}
+///     .AddInclude("<vector>")
+///     .Replace("std::vector<int> values;")
+///     .InsertAfter("static_assert(true);")}
+struct ReflectEdits {
+  ReflectEdits& InsertBefore(std::string text)
+  {
+    edits.push_back(ReflectEdit{ReflectEdit::Kind::kInsertBefore
+                                , std::move(text)});
+    return *this;
+  }
+
+  ReflectEdits& InsertAfter(std::string text)
+  {
+    edits.push_back(ReflectEdit{ReflectEdit::Kind::kInsertAfter
+                                , std::move(text)});
+    return *this;
+  }
+
+  ReflectEdits& Replace(std::string text)
+  {
+    edits.push_back(ReflectEdit{ReflectEdit::Kind::kReplace
+                                , std::move(text)});
+    return *this;
+  }
+
+  ReflectEdits& AddInclude(std::string header)
+  {
+    edits.push_back(ReflectEdit{ReflectEdit::Kind::kAddInclude
+                                , std::move(header)});
+    return *this;
+  }
+
+  ReflectEdits& AppendToFile(std::string text)
+  {
+    edits.push_back(ReflectEdit{ReflectEdit::Kind::kAppendToFile
+                                , std::move(text)});
+    return *this;
+  }
+
+  std::vector<ReflectEdit> edits;
+};
+
+} // namespace plugin
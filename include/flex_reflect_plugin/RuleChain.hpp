@@ -0,0 +1,52 @@
+﻿#pragma once
+
+#include <base/callback.h>
+#include <base/macros.h>
+#include <base/threading/simple_thread.h>
+
+#include <vector>
+
+namespace plugin {
+
+// runs rules of one annotation in order of declaration.
+/// \note consecutive pure rules are executed concurrently
+/// (if there is more than one and |pool| is provided),
+/// their results are applied in order after whole group.
+/// Any other rule has result applied right after it ran,
+/// so next rule (that may read rewriter) observes it.
+class RuleChain {
+public:
+  struct Step {
+    // called on thread of pool if rule is in concurrent group
+    base::RepeatingClosure runRule;
+
+    // called on calling thread
+    base::OnceClosure applyResult;
+
+    // pure rule only reads AST and returns text
+    bool isPure = false;
+  };
+
+  // |pool| may be nullptr, then all rules run on calling thread
+  explicit RuleChain(
+    base::DelegateSimpleThreadPool* pool);
+
+  ~RuleChain();
+
+  void AddStep(
+    Step step);
+
+  // |beforeConcurrentRun| is called on calling thread
+  // before each group of concurrently executed rules
+  void Run(
+    const base::RepeatingClosure& beforeConcurrentRun);
+
+private:
+  base::DelegateSimpleThreadPool* pool_;
+
+  std::vector<Step> steps_;
+
+  DISALLOW_COPY_AND_ASSIGN(RuleChain);
+};
+
+} // namespace plugin
@@ -0,0 +1,88 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/time/time.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace Corrade {
+namespace Utility {
+class ConfigurationGroup;
+} // namespace Utility
+} // namespace Corrade
+
+namespace plugin {
+
+/// \note options are read from optional `[configuration]` section
+/// of `flex_reflect_plugin.conf`
+struct FlexReflectSettings {
+  static FlexReflectSettings FromConfiguration(
+    const ::Corrade::Utility::ConfigurationGroup& configuration);
+
+  // directory to store files rewritten by annotation methods.
+  // empty path means that plugin will not emit files
+  base::FilePath outputDir;
+
+  // directory structure below |sourceRoot| is kept in |outputDir|,
+  // empty path means current working directory
+  base::FilePath sourceRoot;
+
+  // directory shared by all translation units of build
+  // to store rewritten annotated headers (requires |outputDir|)
+  base::FilePath headerCacheDir;
+
+  // write Makefile/Ninja depfile next to each generated file
+  // (requires |outputDir|)
+  bool emitDepfiles = false;
+
+  // skip traversal of files that contain no annotation methods
+  // (found by byte search of each file)
+  bool prescanAnnotations = false;
+
+  // arguments and include paths of interpreter created by plugin
+  // (used only if host application did not register interpreter)
+  std::vector<std::string> interpreterArgs;
+
+  std::vector<std::string> interpreterIncludeDirs;
+
+  // check code of `executeCode` and `executeCodeAndReplace`
+  // annotations in parallel before it is passed to interpreter
+  bool prevalidateSnippets = false;
+
+  // compiler arguments used to check interpreted code
+  // (`-std=c++17`, `-include` headers loaded into interpreter etc.)
+  std::vector<std::string> prevalidationArgs;
+
+  // amount of threads used to check interpreted code
+  int prevalidationThreads = 1;
+
+  // `funccall` rules that only read AST and return text,
+  // consecutive pure rules of one declaration run concurrently
+  std::set<std::string> pureRules;
+
+  // amount of threads used to run pure rules
+  int ruleThreads = 1;
+
+  // time budget of single interpreted snippet,
+  // zero disables budget
+  base::TimeDelta snippetBudget;
+
+  // time budget of all interpreted snippets of translation unit,
+  // zero disables budget
+  base::TimeDelta translationUnitBudget;
+
+  // abort process if snippet exceeded budget
+  // (instead of skipping its result).
+  /// \note if false, snippet that never returns is only reported
+  /// by watchdog and stalls codegen forever
+  bool abortOverBudget = false;
+
+  // file to append snippets that took longer than |slowSnippetThreshold|
+  base::FilePath slowSnippetLog;
+
+  base::TimeDelta slowSnippetThreshold;
+};
+
+} // namespace plugin
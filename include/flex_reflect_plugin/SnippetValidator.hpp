@@ -0,0 +1,55 @@
+﻿#pragma once
+
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+
+#include <set>
+#include <string>
+#include <vector>
+
+namespace clang {
+class AnnotateAttr;
+class ASTContext;
+} // namespace clang
+
+namespace plugin {
+
+class AnnotationPrescanner;
+
+/// \note parses code of `executeCode`, `executeCodeAndReplace`
+/// and `executeCodeAndEdit`
+/// annotations using standalone clang parsers on worker threads,
+/// so broken code is reported (with location of annotation)
+/// before any code is executed by Cling C++ interpreter.
+/// \note snippets are validated in order of translation unit,
+/// declarations and includes of valid `executeCode` snippets
+/// are visible to later snippets (like in interpreter).
+/// Headers loaded into interpreter by host application
+/// must be provided using |compilerArgs| (`-include`, `-I` etc.)
+/// \note diagnostics are collected per snippet
+/// and logged with location of its annotation.
+class SnippetValidator {
+public:
+  SnippetValidator(
+    const std::vector<std::string>& compilerArgs
+    , int numThreads);
+
+  ~SnippetValidator();
+
+  // returns annotations with code that can not be compiled.
+  // |prescanner| (may be nullptr) excludes files without annotations
+  std::set<const clang::AnnotateAttr*> ValidateTranslationUnit(
+    clang::ASTContext& context
+    , AnnotationPrescanner* prescanner);
+
+private:
+  std::vector<std::string> compilerArgs_;
+
+  int numThreads_;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(SnippetValidator);
+};
+
+} // namespace plugin
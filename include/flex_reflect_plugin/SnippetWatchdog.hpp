@@ -0,0 +1,117 @@
+﻿#pragma once
+
+#include <base/files/file.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/synchronization/lock.h>
+#include <base/thread_annotations.h>
+#include <base/time/time.h>
+
+#include <memory>
+#include <string>
+
+namespace plugin {
+
+struct FlexReflectSettings;
+
+/// \note Cling interpreter can not be interrupted,
+/// so watchdog thread only reports snippet that exceeded its budget
+/// (or aborts process if `abort_over_budget` is set).
+/// Result of over budget snippet is not applied
+/// and remaining snippets of translation unit are skipped
+/// when budget of translation unit is exhausted.
+/// \note without `abort_over_budget` snippet that never returns
+/// stalls codegen forever, watchdog only reports it.
+class SnippetWatchdog {
+public:
+  // measures execution of single snippet
+  class ScopedSnippet {
+  public:
+    // |watchdog| may be nullptr if budgets are disabled
+    ScopedSnippet(
+      SnippetWatchdog* watchdog
+      , const std::string& location
+      , const std::string& snippetHash);
+
+    ~ScopedSnippet();
+
+    // returns true if snippet exceeded its budget
+    bool IsOverBudget() const;
+
+  private:
+    SnippetWatchdog* watchdog_;
+
+    base::TimeTicks startTime_;
+
+    DISALLOW_COPY_AND_ASSIGN(ScopedSnippet);
+  };
+
+  explicit SnippetWatchdog(
+    const FlexReflectSettings& settings);
+
+  ~SnippetWatchdog();
+
+  // returns false if settings do not require watchdog
+  static bool IsRequired(
+    const FlexReflectSettings& settings);
+
+  void ResetTranslationUnit();
+
+  // returns false if snippets of current translation unit
+  // used all time budget of translation unit
+  bool HasTranslationUnitBudget() const;
+
+private:
+  class BudgetAlarm;
+
+  void snippetStarted(
+    const std::string& location
+    , const std::string& snippetHash);
+
+  void snippetFinished(
+    base::TimeDelta elapsed);
+
+  bool isOverBudget() const;
+
+  // called on watchdog thread
+  void onAlarm();
+
+  // appends line to slow snippet log (if enabled)
+  void writeSlowSnippet(
+    base::TimeDelta elapsed
+    , const std::string& status)
+    EXCLUSIVE_LOCKS_REQUIRED(lock_);
+
+private:
+  const base::TimeDelta snippetBudget_;
+
+  const base::TimeDelta translationUnitBudget_;
+
+  const base::TimeDelta slowSnippetThreshold_;
+
+  const bool abortOverBudget_;
+
+  // null if both budgets are disabled
+  std::unique_ptr<BudgetAlarm> alarm_;
+
+  // time used by snippets of current translation unit
+  base::TimeDelta translationUnitTime_;
+
+  mutable base::Lock lock_;
+
+  std::string location_ GUARDED_BY(lock_);
+
+  std::string snippetHash_ GUARDED_BY(lock_);
+
+  base::TimeTicks snippetStartTime_ GUARDED_BY(lock_);
+
+  bool isOverBudget_ GUARDED_BY(lock_) = false;
+
+  base::File slowSnippetLog_ GUARDED_BY(lock_);
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(SnippetWatchdog);
+};
+
+} // namespace plugin
@@ -0,0 +1,134 @@
+﻿#pragma once
+
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp>
+
+#include <base/files/file.h>
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+#include <base/strings/string_piece.h>
+
+#include <clang/Basic/SourceLocation.h>
+
+#include <cstddef>
+#include <string>
+
+namespace clang {
+class Decl;
+class Rewriter;
+} // namespace clang
+
+namespace plugin {
+
+/// \note appends generated code directly into rewrite buffer,
+/// so `funccall` rule does not need to keep whole output in memory
+/// and return it using `SourceTransformResult::replacer`.
+/// Rule that uses sink must return `replacer == nullptr`
+/// and must not be listed in `pure_rules` (sink uses rewriter).
+/// EXAMPLE:
+///   StreamingReplacementSink sink(
+///     sourceTransformOptions.rewriter
+///     , sourceTransformOptions.decl);
+///   for(...) {
+///     sink.Append(row);
+///   }
+///   if(sink.Finish().isFailed) {
+///     // report error of rule, output is incomplete
+///   }
+///   return clang_utils::SourceTransformResult{nullptr};
+class StreamingReplacementSink {
+public:
+  struct Options {
+    // output larger than |spillThreshold| bytes
+    // is written into |spillFile| and included from rewritten file,
+    // zero disables spilling.
+    /// \note chunks are streamed into temporary file
+    /// that replaces |spillFile| only if contents changed
+    size_t spillThreshold = 0;
+
+    base::FilePath spillFile;
+
+    // spelling of |spillFile| in `#include "..."`
+    // (like path relative to include directory),
+    // absolute |spillFile| is used if empty.
+    /// \note must not contain `"` or line breaks
+    /// (spill file is not used then)
+    std::string includeName;
+  };
+
+  struct Report {
+    size_t chunks = 0;
+
+    // bytes appended into rewrite buffer
+    size_t bufferBytes = 0;
+
+    // bytes written into spill file
+    size_t spilledBytes = 0;
+
+    // false if spill file kept old contents (and modification time)
+    bool spillFileChanged = false;
+
+    // true if chunks were dropped because spill file
+    // can not be written, rule must report error
+    bool isFailed = false;
+  };
+
+  StreamingReplacementSink(
+    clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl
+    , const Options& options = Options{});
+
+  ~StreamingReplacementSink();
+
+  // first chunk replaces annotated declaration,
+  // other chunks are inserted after it.
+  // returns false if spill file can not be written,
+  // then sink is failed and drops all later chunks
+  bool Append(
+    base::StringPiece chunk);
+
+  // includes spill file (if any) and logs size report.
+  /// \note old code is kept if nothing was appended
+  /// \note spill file is not included if it can not be written
+  const Report& Finish();
+
+  const Report& report() const
+  {
+    return report_;
+  }
+
+private:
+  bool appendToSpillFile(
+    base::StringPiece chunk);
+
+  std::string includeName() const;
+
+private:
+  clang::Rewriter& rewriter_;
+
+  const clang::Decl* nodeDecl_;
+
+  Options options_;
+
+  // token range of annotated declaration
+  clang::SourceLocation startLoc_;
+
+  clang::SourceLocation endLoc_;
+
+  // temporary file next to |options_.spillFile|
+  base::FilePath tempSpillFile_;
+
+  base::File spillFile_;
+
+  GeneratedFileWriter spillFileWriter_;
+
+  Report report_;
+
+  bool isFinished_ = false;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(StreamingReplacementSink);
+};
+
+} // namespace plugin
@@ -1,13 +1,30 @@
 ﻿#pragma once
 
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp>
+#include <flex_reflect_plugin/DependencyTracker.hpp>
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp>
+#include <flex_reflect_plugin/HeaderRewriteCache.hpp>
+#include <flex_reflect_plugin/Settings.hpp>
+#include <flex_reflect_plugin/SnippetValidator.hpp>
+#include <flex_reflect_plugin/SnippetWatchdog.hpp>
+
 #include <flexlib/clangUtils.hpp>
 #include <flexlib/ToolPlugin.hpp>
 #if defined(CLING_IS_ON)
 #include "flexlib/ClingInterpreterModule.hpp"
 #endif // CLING_IS_ON
 
+#include <base/callback.h>
 #include <base/logging.h>
+#include <base/threading/simple_thread.h>
 #include <base/sequenced_task_runner.h>
+#include <base/files/file_path.h>
+#include <base/strings/string_piece.h>
+
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
 
 namespace plugin {
 
@@ -15,10 +32,20 @@ namespace plugin {
 /// class names from other loaded plugins
 class ReflectTooling {
 public:
+#if defined(CLING_IS_ON)
+  // returns interpreter, may create it.
+  /// \note called only when interpreted code must be executed,
+  /// so translation units that use only `funccall`
+  /// never create interpreter
+  using ClingInterpreterProvider
+    = base::RepeatingCallback<::cling_utils::ClingInterpreter*()>;
+#endif // CLING_IS_ON
+
   ReflectTooling(
     const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+    , const FlexReflectSettings& settings
 #if defined(CLING_IS_ON)
-    , ::cling_utils::ClingInterpreter* clingInterpreter
+    , ClingInterpreterProvider clingInterpreterProvider
 #endif // CLING_IS_ON
   );
 
@@ -42,6 +69,16 @@ public:
     , clang::Rewriter& rewriter
     , const clang::Decl* nodeDecl);
 
+  // execute code in Cling C++ interpreter
+  // returned `plugin::ReflectEdits` may modify old code
+  // and surrounding file in single execution
+  void executeCodeAndEdit(
+    const std::string& processedAnnotaion
+    , clang::AnnotateAttr* annotateAttr
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl);
+
   // call some function (argitrary logic) by name.
   // can accept arguments
   void callFuncBySignature(
@@ -51,13 +88,164 @@ public:
     , clang::Rewriter& rewriter
     , const clang::Decl* nodeDecl);
 
+private:
+#if defined(CLING_IS_ON)
+  // resolves interpreter on first use
+  ::cling_utils::ClingInterpreter* clingInterpreter();
+#endif // CLING_IS_ON
+
+#if defined(CLING_IS_ON)
+  // executes |processedAnnotation| as body of lambda
+  // with access to `clangMatchResult`, `clangRewriter`, `clangDecl`,
+  // returns false if code can not be executed.
+  // |isOverBudget| is set if code exceeded time budget,
+  // caller must still free object returned in |result|
+  // and must not apply it
+  bool runInterpretedCode(
+    const std::string& processedAnnotation
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl
+    , cling::Value* result
+    , bool* isOverBudget);
+#endif // CLING_IS_ON
+
+  // detects start of new translation unit
+  // and remembers |rewriter| used by it
+  void enterTranslationUnit(
+    const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter);
+
+  // called when `ASTContext` of translation unit is destroyed
+  static void finishTranslationUnitCallback(
+    void* tooling);
+
+  // writes outputs of translation unit
+  // after all its annotations processed
+  void finishTranslationUnit();
+
+  // checks interpreted code of translation unit
+  // before any code is executed
+  void prevalidateSnippets(
+    const clang_utils::MatchResult& matchResult);
+
+  // returns false if interpreted code of current translation unit
+  // must not be executed (failed validation or used time budget)
+  bool canExecuteSnippets() const;
+
+  // restores annotated headers of translation unit from cache
+  void prepareHeaderCache(
+    const clang_utils::MatchResult& matchResult);
+
+  // returns true if |nodeDecl| belongs to header restored from cache,
+  // so annotation must not be processed again
+  bool isInCachedHeader(
+    const clang_utils::MatchResult& matchResult
+    , const clang::Decl* nodeDecl) const;
+
+  // watches annotation method of |nodeDecl| for edits that
+  // forbid caching of headers, returns null if cache is not used
+  std::unique_ptr<ScopedHeaderCacheCheck> checkHeaderCache(
+    const clang_utils::MatchResult& matchResult
+    , const clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl);
+
+  // header of |fileID| will not be stored in cache
+  void disableHeaderCache(
+    clang::FileID fileID);
+
+  // describes registered rules, part of header cache key
+  std::string ruleSetDescription() const;
+
+  // writes files modified by |rewriter| into |settings_.outputDir|
+  // and stores headers in cache, called once per translation unit
+  void writeRewrittenFiles(
+    clang::Rewriter& rewriter);
+
+  // writes generated file (and depfile) of |sourceFile|
+  // skipping files that did not change since last run
+  void writeGeneratedFile(
+    const base::FilePath& sourceFile
+    , base::StringPiece contents);
+
+  // logs stats and forgets outputs of translation unit
+  void finishOutputs();
+
+  // replaces source code of |nodeDecl| with |text|
+  void replaceDeclText(
+    clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl
+    , base::StringPiece text);
+
+  // remembers files consulted while processing |nodeDecl|,
+  // |interpretedCode| may include headers
+  void recordDependencies(
+    const clang_utils::MatchResult& matchResult
+    , const clang::Decl* nodeDecl
+    , base::StringPiece interpretedCode);
+
+  // returns empty path if generated file of |sourceFile|
+  // can not be written
+  base::FilePath generatedFilePath(
+    const base::FilePath& sourceFile);
+
 private:
   ::clang_utils::SourceTransformRules* sourceTransformRules_;
 
 #if defined(CLING_IS_ON)
-  ::cling_utils::ClingInterpreter* clingInterpreter_;
+  ClingInterpreterProvider clingInterpreterProvider_;
+
+  // null until interpreted code executed for first time
+  ::cling_utils::ClingInterpreter* clingInterpreter_ = nullptr;
 #endif // CLING_IS_ON
 
+  FlexReflectSettings settings_;
+
+  GeneratedFileWriter generatedFileWriter_;
+
+  // depfiles are counted separately from generated files
+  GeneratedFileWriter depfileWriter_;
+
+  DependencyTracker dependencyTracker_;
+
+  std::unique_ptr<SnippetValidator> snippetValidator_;
+
+  // null if time budgets of interpreted code are disabled
+  std::unique_ptr<SnippetWatchdog> snippetWatchdog_;
+
+  std::unique_ptr<HeaderRewriteCache> headerRewriteCache_;
+
+  // null if prescan of files is disabled
+  std::unique_ptr<AnnotationPrescanner> annotationPrescanner_;
+
+  // runs pure rules, null if pure rules run serially
+  std::unique_ptr<base::DelegateSimpleThreadPool> pureRulePool_;
+
+  // headers of current translation unit restored from cache
+  std::set<base::FilePath> cachedHeaders_;
+
+  // cache keys of headers processed by current translation unit
+  std::map<base::FilePath, std::string> headerCacheKeys_;
+
+  // annotations of current translation unit
+  // with code that failed validation
+  std::set<const clang::AnnotateAttr*> invalidSnippets_;
+
+  // absolute path of |settings_.sourceRoot|
+  base::FilePath sourceRoot_;
+
+  // generated file path to its source file,
+  // used to detect collisions of generated files
+  std::map<base::FilePath, base::FilePath> generatedFileSources_;
+
+  // rewriter of current translation unit
+  clang::Rewriter* rewriter_ = nullptr;
+
+  // used to detect start of new translation unit
+  const clang::SourceManager* sourceManager_ = nullptr;
+
+  base::FilePath mainFile_;
+
   SEQUENCE_CHECKER(sequence_checker_);
 
   DISALLOW_COPY_AND_ASSIGN(ReflectTooling);
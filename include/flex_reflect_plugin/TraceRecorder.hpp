@@ -0,0 +1,43 @@
+﻿#pragma once
+
+#include <base/files/file_path.h>
+#include <base/macros.h>
+#include <base/sequence_checker.h>
+
+namespace plugin {
+
+/// \note records trace events of plugin
+/// and saves them in Chrome JSON trace format
+/// (can be opened using `chrome://tracing` or `ui.perfetto.dev`)
+class TraceRecorder {
+public:
+  TraceRecorder();
+
+  ~TraceRecorder();
+
+  // |path| is used by `Stop` if `Stop` called without path,
+  // returns false if |path| is empty
+  bool Start(
+    const base::FilePath& path);
+
+  // stops recording and writes collected events into |path|
+  // (or into path passed to `Start` if |path| is empty)
+  bool Stop(
+    const base::FilePath& path);
+
+  bool IsRecording() const
+  {
+    return isRecording_;
+  }
+
+private:
+  base::FilePath path_;
+
+  bool isRecording_ = false;
+
+  SEQUENCE_CHECKER(sequence_checker_);
+
+  DISALLOW_COPY_AND_ASSIGN(TraceRecorder);
+};
+
+} // namespace plugin
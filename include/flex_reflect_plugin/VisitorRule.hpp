@@ -0,0 +1,35 @@
+﻿#pragma once
+
+#include <flexlib/clangPipeline.hpp>
+
+namespace plugin {
+
+// name of rule used in `{funccall};make_visitor;` annotation
+extern const char kMakeVisitorRule[];
+
+/// \note generates visitor dispatch for annotated polymorphic base class.
+/// Each concrete derived class gets dense
+/// `static constexpr unsigned kFlexVisitorTypeId`
+/// and override of pure virtual `flexVisitorTypeId()` of base
+/// (base becomes abstract, so creation of derived class
+/// that was not found by rule fails to compile),
+/// base gets `flexVisit(visitor)` that calls `visitor(Derived&)`
+/// for dynamic type of object using constexpr table of functions
+/// indexed by type id (one virtual call and one indirect call,
+/// no `dynamic_cast` and no double dispatch).
+/// Derived classes must be defined in same file as base class,
+/// virtual, non-public, template and local derived classes
+/// and classes from anonymous namespace are reported as errors.
+/// EXAMPLE:
+///   struct
+///     __attribute__((annotate("{gen};{funccall};make_visitor;")))
+///   Node {
+///     virtual ~Node() = default;
+///   };
+///   struct Add : Node {};
+///   struct Mul : Node {};
+///   node.flexVisit([](auto& concrete) { ... });
+clang_utils::SourceTransformResult MakeVisitor(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions);
+
+} // namespace plugin
@@ -0,0 +1,201 @@
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/DependencyTracker.hpp>
+
+#include <clang/AST/Decl.h>
+#include <clang/Basic/SourceManager.h>
+
+#include <base/files/memory_mapped_file.h>
+#include <base/logging.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+
+#include <string.h>
+
+namespace plugin {
+
+namespace {
+
+// shorter common prefix (like `{`) is too frequent in C++ code
+static const size_t kMinAnchorSize = 4;
+
+// tokens that start with same |anchor|
+struct TokenGroup {
+  std::string anchor;
+
+  std::vector<std::string> tokens;
+};
+
+// groups tokens by common prefix of method names,
+// like `{executeCode` of `{executeCode};` and `{executeCodeAndEdit};`
+static std::vector<TokenGroup> GroupTokensByPrefix(
+  std::vector<std::string> tokens)
+{
+  std::sort(tokens.begin(), tokens.end());
+  std::vector<TokenGroup> groups;
+  for(const std::string& token : tokens) {
+    DCHECK(!token.empty());
+    if(!groups.empty()) {
+      std::string& anchor = groups.back().anchor;
+      const size_t commonSize = std::mismatch(
+        anchor.begin()
+        , anchor.begin() + std::min(anchor.size(), token.size())
+        , token.begin()).first - anchor.begin();
+      if(commonSize >= kMinAnchorSize) {
+        anchor.resize(commonSize);
+        groups.back().tokens.push_back(token);
+        continue;
+      }
+    }
+    groups.push_back(TokenGroup{token, {token}});
+  }
+  return groups;
+}
+
+} // namespace
+
+AnnotationPrescanner::AnnotationPrescanner(
+  const std::vector<std::string>& tokens)
+  : tokens_(tokens)
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+
+  DCHECK(!tokens_.empty());
+}
+
+AnnotationPrescanner::~AnnotationPrescanner()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+// static
+bool AnnotationPrescanner::ContainsAnyToken(
+  base::StringPiece data
+  , const std::vector<std::string>& tokens)
+{
+  /// \note first byte of tokens (`{`) is frequent in C++ code,
+  /// so `{` with name of method is searched by `memmem`
+  /// (vectorized by libc), one pass per group of tokens
+  /// with common prefix, candidates are compared with tokens of group
+  const char* const end = data.data() + data.size();
+  for(const TokenGroup& group : GroupTokensByPrefix(tokens)) {
+    const char* candidate = data.data();
+    while(candidate < end) {
+      candidate = static_cast<const char*>(
+        memmem(candidate, end - candidate
+               , group.anchor.data(), group.anchor.size()));
+      if(!candidate) {
+        break;
+      }
+      const base::StringPiece rest(candidate, end - candidate);
+      for(const std::string& token : group.tokens) {
+        if(rest.starts_with(token)) {
+          return true;
+        }
+      }
+      candidate++;
+    }
+  }
+  return false;
+}
+
+bool AnnotationPrescanner::MayContainAnnotations(
+  const base::FilePath& path)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  auto it = scannedFiles_.find(path);
+  if(it != scannedFiles_.end()) {
+    return it->second;
+  }
+
+  TRACE_EVENT0("toplevel",
+               "plugin::AnnotationPrescanner::scanFile");
+
+  bool mayContainAnnotations = true;
+  base::MemoryMappedFile mappedFile;
+  if(!mappedFile.Initialize(path)) {
+    VLOG(9)
+      << "unable to map file for prescan: "
+      << path;
+    failedFiles_++;
+  } else {
+    mayContainAnnotations = ContainsAnyToken(
+      base::StringPiece(
+        reinterpret_cast<const char*>(mappedFile.data())
+        , mappedFile.length())
+      , tokens_);
+    if(mayContainAnnotations) {
+      filesWithAnnotations_++;
+    } else {
+      skippedFiles_++;
+    }
+  }
+
+  scannedFiles_[path] = mayContainAnnotations;
+  return mayContainAnnotations;
+}
+
+void AnnotationPrescanner::LogStats() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  VLOG(1)
+    << "annotation prescan: "
+    << skippedFiles_
+    << " files without annotations skipped, "
+    << filesWithAnnotations_
+    << " files with annotations, "
+    << failedFiles_
+    << " files not scanned";
+}
+
+TranslationUnitFileFilter::TranslationUnitFileFilter(
+  AnnotationPrescanner* prescanner
+  , const clang::SourceManager& sourceManager)
+  : prescanner_(prescanner)
+  , sourceManager_(sourceManager)
+{}
+
+TranslationUnitFileFilter::~TranslationUnitFileFilter()
+{
+  VLOG_IF(9, prescanner_)
+    << "prescan skipped traversal of "
+    << skippedDecls_
+    << " declarations";
+}
+
+bool TranslationUnitFileFilter::ShouldTraverse(
+  const clang::Decl* decl)
+{
+  if(!prescanner_ || !decl
+     || llvm::isa<clang::TranslationUnitDecl>(decl))
+  {
+    return true;
+  }
+
+  const clang::SourceLocation loc
+    = sourceManager_.getExpansionLoc(decl->getBeginLoc());
+  if(loc.isInvalid()) {
+    return true;
+  }
+
+  const clang::FileID fileID = sourceManager_.getFileID(loc);
+  auto it = fileResults_.find(fileID);
+  if(it == fileResults_.end()) {
+    const base::FilePath filePath
+      = FilePathOfLocation(sourceManager_, loc);
+    const bool mayContainAnnotations
+      = filePath.empty()
+        || prescanner_->MayContainAnnotations(filePath);
+    it = fileResults_.emplace(fileID, mayContainAnnotations).first;
+  }
+
+  if(!it->second) {
+    skippedDecls_++;
+  }
+  return it->second;
+}
+
+} // namespace plugin
@@ -0,0 +1,302 @@
+#include <flex_reflect_plugin/AnnotationTokenizer.hpp> // IWYU pragma: associated
+
+#include <base/cpu.h>
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+#include <build/build_config.h>
+
+#include <limits>
+#include <utility>
+
+#if defined(ARCH_CPU_X86_FAMILY)
+#include <immintrin.h>
+#endif // ARCH_CPU_X86_FAMILY
+
+namespace plugin {
+
+namespace {
+
+static const char kDelimiters[] = ";(),=\"";
+
+static const int kNumDelimiters = sizeof(kDelimiters) - 1;
+
+static void FindDelimitersScalar(
+  const char* data
+  , size_t begin
+  , size_t end
+  , std::vector<uint32_t>* offsets)
+{
+  for(size_t i = begin; i < end; i++) {
+    if(IsAnnotationDelimiter(data[i])) {
+      offsets->push_back(static_cast<uint32_t>(i));
+    }
+  }
+}
+
+#if defined(ARCH_CPU_X86_FAMILY)
+static inline void AppendMaskOffsets(
+  uint32_t mask
+  , size_t base
+  , std::vector<uint32_t>* offsets)
+{
+  while(mask) {
+    offsets->push_back(
+      static_cast<uint32_t>(base + __builtin_ctz(mask)));
+    mask &= mask - 1;
+  }
+}
+
+// `pcmpestrm` compares 16 bytes with all delimiters at once
+__attribute__((target("sse4.2")))
+static void FindDelimitersSse42(
+  const char* data
+  , size_t size
+  , std::vector<uint32_t>* offsets)
+{
+  // only first |kNumDelimiters| bytes are compared
+  const __m128i delimiterSet
+    = _mm_setr_epi8(kDelimiters[0], kDelimiters[1], kDelimiters[2]
+                    , kDelimiters[3], kDelimiters[4], kDelimiters[5]
+                    , 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+
+  size_t i = 0;
+  for(; i + 16 <= size; i += 16) {
+    const __m128i chunk
+      = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+    const __m128i mask
+      = _mm_cmpestrm(delimiterSet, kNumDelimiters, chunk, 16
+                     , _SIDD_UBYTE_OPS
+                       | _SIDD_CMP_EQUAL_ANY
+                       | _SIDD_BIT_MASK);
+    AppendMaskOffsets(
+      static_cast<uint32_t>(_mm_cvtsi128_si32(mask)), i, offsets);
+  }
+  FindDelimitersScalar(data, i, size, offsets);
+}
+
+// compares 32 bytes with each delimiter
+__attribute__((target("avx2")))
+static void FindDelimitersAvx2(
+  const char* data
+  , size_t size
+  , std::vector<uint32_t>* offsets)
+{
+  const __m256i semicolon = _mm256_set1_epi8(kDelimiters[0]);
+  const __m256i openParen = _mm256_set1_epi8(kDelimiters[1]);
+  const __m256i closeParen = _mm256_set1_epi8(kDelimiters[2]);
+  const __m256i comma = _mm256_set1_epi8(kDelimiters[3]);
+  const __m256i equals = _mm256_set1_epi8(kDelimiters[4]);
+  const __m256i quote = _mm256_set1_epi8(kDelimiters[5]);
+
+  size_t i = 0;
+  for(; i + 32 <= size; i += 32) {
+    const __m256i chunk
+      = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+    __m256i found = _mm256_cmpeq_epi8(chunk, semicolon);
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, openParen));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, closeParen));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, comma));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, equals));
+    found = _mm256_or_si256(found, _mm256_cmpeq_epi8(chunk, quote));
+    AppendMaskOffsets(
+      static_cast<uint32_t>(_mm256_movemask_epi8(found)), i, offsets);
+  }
+  FindDelimitersScalar(data, i, size, offsets);
+}
+#endif // ARCH_CPU_X86_FAMILY
+
+// quote preceded by odd amount of backslashes is escaped
+static bool IsEscaped(
+  base::StringPiece text
+  , size_t offset)
+{
+  size_t backslashes = 0;
+  while(offset > backslashes
+        && text[offset - backslashes - 1] == '\\')
+  {
+    backslashes++;
+  }
+  return backslashes % 2 == 1;
+}
+
+static base::StringPiece Trimmed(
+  base::StringPiece text
+  , size_t begin
+  , size_t end)
+{
+  return base::TrimWhitespaceASCII(
+    text.substr(begin, end - begin), base::TRIM_ALL);
+}
+
+} // namespace
+
+DelimiterScanner DefaultDelimiterScanner()
+{
+#if defined(ARCH_CPU_X86_FAMILY)
+  static const DelimiterScanner scanner = []() {
+    const base::CPU cpu;
+    if(cpu.has_avx2()) {
+      return DelimiterScanner::kAvx2;
+    }
+    if(cpu.has_sse42()) {
+      return DelimiterScanner::kSse42;
+    }
+    return DelimiterScanner::kScalar;
+  }();
+  return scanner;
+#else
+  return DelimiterScanner::kScalar;
+#endif // ARCH_CPU_X86_FAMILY
+}
+
+bool IsAnnotationDelimiter(char c)
+{
+  switch(c) {
+    case ';':
+    case '(':
+    case ')':
+    case ',':
+    case '=':
+    case '"':
+      return true;
+    default:
+      return false;
+  }
+}
+
+void FindAnnotationDelimiters(
+  DelimiterScanner scanner
+  , base::StringPiece text
+  , std::vector<uint32_t>* offsets)
+{
+  DCHECK(offsets);
+  DCHECK_LE(text.size(), std::numeric_limits<uint32_t>::max());
+
+  switch(scanner) {
+#if defined(ARCH_CPU_X86_FAMILY)
+    case DelimiterScanner::kAvx2: {
+      FindDelimitersAvx2(text.data(), text.size(), offsets);
+      return;
+    }
+    case DelimiterScanner::kSse42: {
+      FindDelimitersSse42(text.data(), text.size(), offsets);
+      return;
+    }
+#endif // ARCH_CPU_X86_FAMILY
+    default: {
+      FindDelimitersScalar(text.data(), 0, text.size(), offsets);
+      return;
+    }
+  }
+}
+
+std::vector<AnnotationCall> TokenizeAnnotation(
+  base::StringPiece annotation
+  , DelimiterScanner scanner)
+{
+  std::vector<uint32_t> offsets;
+  FindAnnotationDelimiters(scanner, annotation, &offsets);
+
+  std::vector<AnnotationCall> calls;
+
+  AnnotationCall call;
+  bool hasParens = false;
+  size_t callBegin = 0;
+  size_t argBegin = 0;
+  size_t equals = base::StringPiece::npos;
+  int depth = 0;
+  bool inQuote = false;
+
+  auto finishArg = [&](size_t argEnd) {
+    AnnotationArg arg;
+    if(equals != base::StringPiece::npos) {
+      arg.name = Trimmed(annotation, argBegin, equals);
+      arg.value = Trimmed(annotation, equals + 1, argEnd);
+    } else {
+      arg.value = Trimmed(annotation, argBegin, argEnd);
+    }
+    if(!arg.name.empty() || !arg.value.empty()) {
+      call.args.push_back(arg);
+    }
+    argBegin = argEnd + 1;
+    equals = base::StringPiece::npos;
+  };
+
+  auto finishCall = [&](size_t callEnd) {
+    call.text = Trimmed(annotation, callBegin, callEnd);
+    if(!hasParens) {
+      call.name = call.text;
+    }
+    if(!call.name.empty()) {
+      calls.push_back(std::move(call));
+    }
+    call = AnnotationCall{};
+    hasParens = false;
+    callBegin = callEnd + 1;
+  };
+
+  for(const uint32_t offset : offsets) {
+    const char c = annotation[offset];
+    if(inQuote) {
+      if(c == '"' && !IsEscaped(annotation, offset)) {
+        inQuote = false;
+      }
+      continue;
+    }
+    switch(c) {
+      case '"': {
+        inQuote = true;
+        break;
+      }
+      case '(': {
+        if(depth == 0 && !hasParens) {
+          hasParens = true;
+          call.name = Trimmed(annotation, callBegin, offset);
+          argBegin = offset + 1;
+          equals = base::StringPiece::npos;
+        }
+        depth++;
+        break;
+      }
+      case ')': {
+        if(depth == 1) {
+          finishArg(offset);
+        }
+        if(depth > 0) {
+          depth--;
+        }
+        break;
+      }
+      case ',': {
+        if(depth == 1) {
+          finishArg(offset);
+        }
+        break;
+      }
+      case '=': {
+        if(depth == 1 && equals == base::StringPiece::npos) {
+          equals = offset;
+        }
+        break;
+      }
+      case ';': {
+        if(depth == 0) {
+          finishCall(offset);
+        }
+        break;
+      }
+      default: {
+        NOTREACHED();
+        break;
+      }
+    }
+  }
+
+  if(callBegin < annotation.size()) {
+    finishCall(annotation.size());
+  }
+
+  return calls;
+}
+
+} // namespace plugin
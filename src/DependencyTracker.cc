@@ -0,0 +1,315 @@
+#include <flex_reflect_plugin/DependencyTracker.hpp> // IWYU pragma: associated
+
+#include <clang/AST/Decl.h>
+#include <clang/AST/DeclTemplate.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/AST/TypeLoc.h>
+#include <clang/Basic/SourceManager.h>
+
+#include <base/logging.h>
+#include <base/files/file_util.h>
+#include <base/stl_util.h>
+#include <base/strings/string_util.h>
+#include <base/trace_event/trace_event.h>
+
+namespace plugin {
+
+namespace {
+
+static const char kIncludeDirective[] = "#include";
+
+// collects files that declare types used by visited declaration
+class ReferencedTypesVisitor
+  : public clang::RecursiveASTVisitor<ReferencedTypesVisitor> {
+public:
+  ReferencedTypesVisitor(
+    const clang::SourceManager& sourceManager
+    , std::set<base::FilePath>& files)
+    : sourceManager_(sourceManager)
+    , files_(files)
+  {}
+
+  bool VisitTagTypeLoc(clang::TagTypeLoc typeLoc)
+  {
+    const clang::TagDecl* tagDecl = typeLoc.getDecl();
+    addDecl(tagDecl);
+    if(tagDecl) {
+      addDecl(tagDecl->getDefinition());
+    }
+    return true;
+  }
+
+  bool VisitTypedefTypeLoc(clang::TypedefTypeLoc typeLoc)
+  {
+    addDecl(typeLoc.getTypedefNameDecl());
+    return true;
+  }
+
+  bool VisitTemplateSpecializationTypeLoc(
+    clang::TemplateSpecializationTypeLoc typeLoc)
+  {
+    addDecl(typeLoc.getTypePtr()->getTemplateName().getAsTemplateDecl());
+    return true;
+  }
+
+private:
+  void addDecl(const clang::Decl* decl)
+  {
+    if(!decl) {
+      return;
+    }
+    base::FilePath filePath
+      = FilePathOfLocation(sourceManager_, decl->getLocation());
+    if(!filePath.empty()) {
+      files_.insert(filePath);
+    }
+  }
+
+private:
+  const clang::SourceManager& sourceManager_;
+
+  std::set<base::FilePath>& files_;
+};
+
+} // namespace
+
+std::string EscapeDepfilePath(
+  const base::FilePath& path)
+{
+  std::string result;
+  result.reserve(path.value().size());
+  for(const char c : path.value()) {
+    switch(c) {
+      case ' ':
+        result += "\\ ";
+        break;
+      case '#':
+        result += "\\#";
+        break;
+      case '$':
+        result += "$$";
+        break;
+      default:
+        result += c;
+        break;
+    }
+  }
+  return result;
+}
+
+std::vector<SnippetInclude> ParseSnippetIncludes(
+  base::StringPiece snippet)
+{
+  std::vector<SnippetInclude> includes;
+
+  size_t pos = 0;
+  while((pos = snippet.find(kIncludeDirective, pos))
+        != base::StringPiece::npos)
+  {
+    pos += base::size(kIncludeDirective) - 1;
+    while(pos < snippet.size()
+          && (snippet[pos] == ' ' || snippet[pos] == '\t'))
+    {
+      pos++;
+    }
+    if(pos >= snippet.size()) {
+      break;
+    }
+
+    const bool isQuoted = snippet[pos] == '"';
+    if(!isQuoted && snippet[pos] != '<') {
+      continue;
+    }
+
+    const size_t end = snippet.find(isQuoted ? '"' : '>', pos + 1);
+    if(end == base::StringPiece::npos) {
+      break;
+    }
+    includes.push_back(SnippetInclude{
+      snippet.substr(pos + 1, end - pos - 1).as_string()
+      , isQuoted});
+    pos = end + 1;
+  }
+  return includes;
+}
+
+base::FilePath FilePathOfLocation(
+  const clang::SourceManager& sourceManager
+  , clang::SourceLocation loc)
+{
+  if(loc.isInvalid()) {
+    return base::FilePath{};
+  }
+
+  const clang::FileEntry* fileEntry
+    = sourceManager.getFileEntryForID(
+        sourceManager.getFileID(sourceManager.getExpansionLoc(loc)));
+  if(!fileEntry) {
+    return base::FilePath{};
+  }
+
+  return base::FilePath{fileEntry->getName().str()};
+}
+
+void CollectDeclDependencies(
+  const clang::SourceManager& sourceManager
+  , const clang::Decl* nodeDecl
+  , std::set<base::FilePath>* files)
+{
+  DCHECK(nodeDecl);
+  DCHECK(files);
+
+  const base::FilePath sourceFile
+    = FilePathOfLocation(sourceManager, nodeDecl->getBeginLoc());
+  if(!sourceFile.empty()) {
+    files->insert(sourceFile);
+  }
+
+  ReferencedTypesVisitor visitor(sourceManager, *files);
+  visitor.TraverseDecl(const_cast<clang::Decl*>(nodeDecl));
+}
+
+DependencyTracker::DependencyTracker()
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+DependencyTracker::~DependencyTracker()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+void DependencyTracker::ResetTranslationUnit(
+  const clang::SourceManager& sourceManager)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  translationUnitFiles_.clear();
+  for(auto it = sourceManager.fileinfo_begin();
+      it != sourceManager.fileinfo_end(); ++it)
+  {
+    const clang::FileEntry* fileEntry = it->first;
+    if(fileEntry) {
+      translationUnitFiles_.insert(
+        base::FilePath{fileEntry->getName().str()});
+    }
+  }
+}
+
+void DependencyTracker::AddDeclDependencies(
+  const base::FilePath& sourceFile
+  , const clang::SourceManager& sourceManager
+  , const clang::Decl* nodeDecl)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::DependencyTracker::AddDeclDependencies");
+
+  DCHECK(nodeDecl);
+
+  if(sourceFile.empty()) {
+    return;
+  }
+
+  std::set<base::FilePath>& files = dependencies_[sourceFile];
+  files.insert(sourceFile);
+  CollectDeclDependencies(sourceManager, nodeDecl, &files);
+}
+
+void DependencyTracker::AddDependencies(
+  const base::FilePath& sourceFile
+  , const std::set<base::FilePath>& dependencies)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  dependencies_[sourceFile].insert(
+    dependencies.begin(), dependencies.end());
+}
+
+void DependencyTracker::AddSnippetIncludes(
+  const base::FilePath& sourceFile
+  , base::StringPiece snippet)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(sourceFile.empty()) {
+    return;
+  }
+
+  std::set<base::FilePath>& files = dependencies_[sourceFile];
+
+  for(const SnippetInclude& include : ParseSnippetIncludes(snippet)) {
+    const std::string& includeName = include.name;
+    const bool isQuoted = include.isQuoted;
+
+    base::FilePath resolved;
+    const base::FilePath includePath{includeName};
+    if(includePath.IsAbsolute()) {
+      resolved = includePath;
+    } else if(isQuoted
+              && base::PathExists(sourceFile.DirName().Append(includePath)))
+    {
+      resolved = sourceFile.DirName().Append(includePath);
+    } else {
+      // interpreter uses same include paths as translation unit,
+      // so search for header between files of translation unit
+      for(const base::FilePath& file : translationUnitFiles_) {
+        if(base::EndsWith(file.value(), "/" + includeName
+                          , base::CompareCase::SENSITIVE))
+        {
+          resolved = file;
+          break;
+        }
+      }
+    }
+
+    if(resolved.empty()) {
+      VLOG(1)
+        << "unable to resolve header included by interpreted code: "
+        << includeName;
+      continue;
+    }
+    files.insert(resolved);
+  }
+}
+
+void DependencyTracker::AddCommonDependency(
+  const base::FilePath& dependency)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!dependency.empty()) {
+    commonDependencies_.insert(dependency);
+  }
+}
+
+std::string DependencyTracker::FormatDepfile(
+  const base::FilePath& sourceFile
+  , const base::FilePath& target) const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  std::set<base::FilePath> files = commonDependencies_;
+  files.insert(sourceFile);
+  auto it = dependencies_.find(sourceFile);
+  if(it != dependencies_.end()) {
+    files.insert(it->second.begin(), it->second.end());
+  }
+
+  std::string result = EscapeDepfilePath(target) + ":";
+  for(const base::FilePath& file : files) {
+    result += " \\\n  ";
+    result += EscapeDepfilePath(file);
+  }
+  result += "\n";
+  return result;
+}
+
+void DependencyTracker::Clear()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  dependencies_.clear();
+}
+
+} // namespace plugin
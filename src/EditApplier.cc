@@ -0,0 +1,237 @@
+#include <flex_reflect_plugin/EditApplier.hpp> // IWYU pragma: associated
+
+#include <flexlib/clangUtils.hpp>
+
+#include <clang/AST/Decl.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/strings/string_util.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+#include <iterator>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+static const char kIncludeDirective[] = "#include ";
+
+// returns true if |line| starts at beginning of some line of text,
+// works with rewritten file (rope)
+template <typename Iterator>
+static bool ContainsLine(
+  Iterator begin
+  , Iterator end
+  , const std::string& line)
+{
+  if(static_cast<size_t>(std::distance(begin, end)) >= line.size()
+     && std::equal(line.begin(), line.end(), begin))
+  {
+    return true;
+  }
+  const std::string needle = "\n" + line;
+  return std::search(begin, end, needle.begin(), needle.end()) != end;
+}
+
+// |header| without `<>` or `""` and surrounding whitespace
+static base::StringPiece HeaderName(
+  base::StringPiece header)
+{
+  header = base::TrimWhitespaceASCII(header, base::TRIM_ALL);
+  if(header.size() >= 2
+     && ((header.front() == '<' && header.back() == '>')
+         || (header.front() == '"' && header.back() == '"')))
+  {
+    header = base::TrimWhitespaceASCII(
+      header.substr(1, header.size() - 2), base::TRIM_ALL);
+  }
+  return header;
+}
+
+// name of header as written in `#include` directive,
+// |includeLoc| points to `<header>` or `"header"` token
+// (empty if name produced by macro)
+static base::StringPiece SpelledHeaderName(
+  const clang::SourceManager& sourceManager
+  , clang::SourceLocation includeLoc)
+{
+  if(!includeLoc.isFileID()) {
+    return base::StringPiece{};
+  }
+
+  const std::pair<clang::FileID, unsigned> decomposedLoc
+    = sourceManager.getDecomposedLoc(includeLoc);
+  const llvm::StringRef text
+    = sourceManager.getBufferData(decomposedLoc.first)
+        .substr(decomposedLoc.second);
+  if(text.empty() || (text.front() != '<' && text.front() != '"')) {
+    return base::StringPiece{};
+  }
+
+  const char closing = text.front() == '<' ? '>' : '"';
+  const size_t end = text.find_first_of(
+    llvm::StringRef(&closing, 1), 1);
+  if(end == llvm::StringRef::npos) {
+    return base::StringPiece{};
+  }
+  return base::StringPiece(text.data() + 1, end - 1);
+}
+
+// returns true if preprocessor included |headerName| into |fileID|,
+// `<header>` and `"header"` forms of same header match
+/// \note files are taken from `SourceManager`,
+/// so comments and disabled `#if` blocks are not matched
+static bool IsIncludedBy(
+  const clang::SourceManager& sourceManager
+  , clang::FileID fileID
+  , base::StringPiece headerName)
+{
+  for(unsigned i = 0; i < sourceManager.local_sloc_entry_size(); i++) {
+    const clang::SrcMgr::SLocEntry& entry
+      = sourceManager.getLocalSLocEntry(i);
+    if(!entry.isFile()) {
+      continue;
+    }
+
+    const clang::SourceLocation includeLoc
+      = entry.getFile().getIncludeLoc();
+    if(includeLoc.isInvalid()
+       || sourceManager.getFileID(
+            sourceManager.getExpansionLoc(includeLoc)) != fileID)
+    {
+      continue;
+    }
+
+    if(SpelledHeaderName(sourceManager, includeLoc) == headerName) {
+      return true;
+    }
+
+    // same header may be spelled relative to other include path
+    const clang::FileEntry* fileEntry
+      = sourceManager.getFileEntryForID(sourceManager.getFileID(
+          clang::SourceLocation::getFromRawEncoding(entry.getOffset())));
+    if(fileEntry) {
+      const std::string path = fileEntry->getName().str();
+      if(path == headerName
+         || base::EndsWith(path, "/" + headerName.as_string()
+                           , base::CompareCase::SENSITIVE))
+      {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+static clang::FileID FileOfDecl(
+  const clang::SourceManager& sourceManager
+  , const clang::Decl* nodeDecl)
+{
+  return sourceManager.getFileID(
+    sourceManager.getExpansionLoc(nodeDecl->getBeginLoc()));
+}
+
+} // namespace
+
+void AddIncludeOnce(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , base::StringPiece header)
+{
+  DCHECK(nodeDecl);
+  DCHECK(!header.empty());
+
+  const clang::SourceManager& sourceManager = rewriter.getSourceMgr();
+  const clang::FileID fileID = FileOfDecl(sourceManager, nodeDecl);
+
+  const std::string directive
+    = kIncludeDirective
+      + base::TrimWhitespaceASCII(header, base::TRIM_ALL).as_string()
+      + "\n";
+
+  /// \note includes added by previous edits are unknown to preprocessor,
+  /// so rewritten file is searched for line inserted by this function
+  const clang::RewriteBuffer* rewriteBuffer
+    = rewriter.getRewriteBufferFor(fileID);
+  const bool alreadyIncluded
+    = IsIncludedBy(sourceManager, fileID, HeaderName(header))
+      || (rewriteBuffer
+          && ContainsLine(
+               rewriteBuffer->begin(), rewriteBuffer->end(), directive));
+  if(alreadyIncluded) {
+    VLOG(9)
+      << "skipped duplicated include: "
+      << header;
+    return;
+  }
+
+  rewriter.InsertTextBefore(
+    sourceManager.getLocForStartOfFile(fileID)
+    , directive);
+}
+
+void ApplyReflectEdits(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , const ReflectEdits& edits)
+{
+  DCHECK(nodeDecl);
+  TRACE_EVENT0("toplevel",
+               "plugin::ApplyReflectEdits");
+
+  const clang::SourceManager& sourceManager = rewriter.getSourceMgr();
+
+  clang::SourceLocation startLoc = nodeDecl->getBeginLoc();
+  clang::SourceLocation endLoc = nodeDecl->getEndLoc();
+  clang_utils::expandLocations(startLoc, endLoc, rewriter);
+
+  for(const ReflectEdit& edit : edits.edits) {
+    const llvm::StringRef text(edit.text.data(), edit.text.size());
+    switch(edit.kind) {
+      case ReflectEdit::Kind::kInsertBefore: {
+        rewriter.InsertTextBefore(startLoc, text);
+        break;
+      }
+      case ReflectEdit::Kind::kInsertAfter: {
+        rewriter.InsertTextAfterToken(endLoc, text);
+        break;
+      }
+      case ReflectEdit::Kind::kReplace: {
+        /// \note text inserted before declaration by previous edits
+        /// is kept and must not be counted as part of replaced range
+        clang::Rewriter::RewriteOptions rangeOptions;
+        rangeOptions.IncludeInsertsAtBeginOfRange = false;
+        rangeOptions.IncludeInsertsAtEndOfRange = false;
+        rewriter.ReplaceText(
+          startLoc
+          , rewriter.getRangeSize(
+              clang::SourceRange(startLoc, endLoc), rangeOptions)
+          , text);
+        break;
+      }
+      case ReflectEdit::Kind::kAddInclude: {
+        AddIncludeOnce(rewriter, nodeDecl, edit.text);
+        break;
+      }
+      case ReflectEdit::Kind::kAppendToFile: {
+        rewriter.InsertTextAfter(
+          sourceManager.getLocForEndOfFile(
+            FileOfDecl(sourceManager, nodeDecl))
+          , text);
+        break;
+      }
+      default: {
+        NOTREACHED()
+          << "unknown edit kind: "
+          << static_cast<int>(edit.kind);
+        break;
+      }
+    }
+  }
+}
+
+} // namespace plugin
@@ -1,5 +1,7 @@
 #include <flex_reflect_plugin/EventHandler.hpp> // IWYU pragma: associated
 
+#include <flex_reflect_plugin/AnnotationMethods.hpp>
+
 #include <flexlib/ToolPlugin.hpp>
 #include <flexlib/core/errors/errors.hpp>
 #include <flexlib/utils.hpp>
@@ -38,13 +40,25 @@ static const std::string kVersion = "v0.0.1";
 
 static const std::string kVersionCommand = "/version";
 
+// usage:
+//   /trace start <path>
+//   /trace stop
+//   /trace stop <path>
+static const std::string kTraceCommand = "/trace";
+
+static const std::string kTraceStartArg = "start";
+
+static const std::string kTraceStopArg = "stop";
+
 #if !defined(APPLICATION_BUILD_TYPE)
 #define APPLICATION_BUILD_TYPE "local build"
 #endif
 
 } // namespace
 
-FlexReflectEventHandler::FlexReflectEventHandler()
+FlexReflectEventHandler::FlexReflectEventHandler(
+  const FlexReflectSettings& settings)
+  : settings_(settings)
 {
   DETACH_FROM_SEQUENCE(sequence_checker_);
 }
@@ -74,6 +88,32 @@ void FlexReflectEventHandler::StringCommand(
         << APPLICATION_BUILD_TYPE;
     }
   }
+
+  if(event.split_parts.size() >= 2
+     && event.split_parts.size() <= 3
+     && event.split_parts[0] == kTraceCommand)
+  {
+    const base::FilePath tracePath
+      = event.split_parts.size() == 3
+        ? base::FilePath{event.split_parts[2]}
+        : base::FilePath{};
+    if(event.split_parts[1] == kTraceStartArg) {
+      LOG_IF(INFO, traceRecorder_.Start(tracePath))
+        << kPluginDebugLogName
+        << " started trace recording";
+    } else if(event.split_parts[1] == kTraceStopArg) {
+      LOG_IF(INFO, traceRecorder_.Stop(tracePath))
+        << kPluginDebugLogName
+        << " stopped trace recording";
+    } else {
+      LOG(WARNING)
+        << kPluginDebugLogName
+        << " usage: "
+        << kTraceCommand
+        << " " << kTraceStartArg << "|" << kTraceStopArg
+        << " <path>";
+    }
+  }
 }
 
 /**
@@ -88,14 +128,16 @@ void FlexReflectEventHandler::RegisterAnnotationMethods(
   TRACE_EVENT0("toplevel",
                "plugin::FlexReflect::handle_event(RegisterAnnotationMethods)");
 
-#if defined(CLING_IS_ON)
-  DCHECK(clingInterpreter_);
-#endif // CLING_IS_ON
-
+  /// \note interpreter may be registered after annotation methods
+  /// (or not registered at all if only `funccall` is used),
+  /// so tooling requests it only when interpreted code must be executed
   tooling_ = std::make_unique<ReflectTooling>(
     event
+    , settings_
 #if defined(CLING_IS_ON)
-    , clingInterpreter_
+    , base::BindRepeating(
+        &FlexReflectEventHandler::clingInterpreter
+        , base::Unretained(this))
 #endif // CLING_IS_ON
   );
 
@@ -121,7 +163,7 @@ void FlexReflectEventHandler::RegisterAnnotationMethods(
       << "registered annotation method:"
          " executeCode";
     CHECK(tooling_);
-    annotationMethods["{executeCode};"] =
+    annotationMethods[kExecuteCodeMethod] =
       base::BindRepeating(
         &ReflectTooling::executeCode
         , base::Unretained(tooling_.get()));
@@ -141,12 +183,36 @@ void FlexReflectEventHandler::RegisterAnnotationMethods(
       << "registered annotation method:"
          " executeCodeAndReplace";
     CHECK(tooling_);
-    annotationMethods["{executeCodeAndReplace};"] =
+    annotationMethods[kExecuteCodeAndReplaceMethod] =
       base::BindRepeating(
         &ReflectTooling::executeCodeAndReplace
         , base::Unretained(tooling_.get()));
   }
 
+  // embeds arbitrary C++ code and edits surrounding file
+  // using single execution of interpreted code
+  /**
+    EXAMPLE:
+      // will be replaced with `std::vector<int> values;`,
+      // `#include <vector>` will be added at top of file
+      __attribute__((annotate("{gen};{executeCodeAndEdit};\
+      new plugin::ReflectEdits{plugin::ReflectEdits{}\
+        .AddInclude(\"<vector>\")\
+        .Replace(\"std::vector<int> values;\")};")))
+      int SOME_UNIQUE_NAME3
+      ;
+  **/
+  {
+    VLOG(9)
+      << "registered annotation method:"
+         " executeCodeAndEdit";
+    CHECK(tooling_);
+    annotationMethods[kExecuteCodeAndEditMethod] =
+      base::BindRepeating(
+        &ReflectTooling::executeCodeAndEdit
+        , base::Unretained(tooling_.get()));
+  }
+
   /**
     EXAMPLE:
       #include <string>
@@ -170,7 +236,7 @@ void FlexReflectEventHandler::RegisterAnnotationMethods(
       << "registered annotation method:"
          " funccall";
     CHECK(tooling_);
-    annotationMethods["{funccall};"] =
+    annotationMethods[kFunccallMethod] =
       base::BindRepeating(
         &ReflectTooling::callFuncBySignature
         , base::Unretained(tooling_.get()));
@@ -188,6 +254,32 @@ void FlexReflectEventHandler::RegisterClingInterpreter(
   DCHECK(event.clingInterpreter);
   clingInterpreter_ = event.clingInterpreter;
 }
+
+::cling_utils::ClingInterpreter*
+  FlexReflectEventHandler::clingInterpreter()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(clingInterpreter_) {
+    return clingInterpreter_;
+  }
+
+  /// \note Cling startup is paid only by translation units
+  /// that execute interpreted code
+  if(!ownClingInterpreter_) {
+    TRACE_EVENT0("toplevel",
+                 "plugin::EventHandler::createClingInterpreter");
+    VLOG(9)
+      << kPluginDebugLogName
+      << " Cling interpreter was not registered by host application,"
+         " creating interpreter of plugin";
+    ownClingInterpreter_ = std::make_unique<::cling_utils::ClingInterpreter>(
+      kPluginDebugLogName
+      , settings_.interpreterArgs
+      , settings_.interpreterIncludeDirs);
+  }
+  return ownClingInterpreter_.get();
+}
 #endif // CLING_IS_ON
 
 } // namespace plugin
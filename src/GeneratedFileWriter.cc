@@ -0,0 +1,203 @@
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp> // IWYU pragma: associated
+
+#include <base/logging.h>
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
+#include <base/files/memory_mapped_file.h>
+#include <base/hash/sha1.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+namespace plugin {
+
+namespace {
+
+static const char kGeneratedFileSuffix[] = ".generated";
+
+// stores generated files of sources outside of source root
+static const char kExternalSourcesDir[] = "_external";
+
+static std::string ContentHashOfBytes(
+  const unsigned char* data
+  , size_t length)
+{
+  unsigned char hash[base::kSHA1Length];
+  base::SHA1HashBytes(data, length, hash);
+  return base::HexEncode(hash, base::kSHA1Length);
+}
+
+// compares |contents| with file stored on disk.
+// file is memory-mapped, so old contents are not copied into memory
+static bool HasSameContents(
+  const base::FilePath& path
+  , base::StringPiece contents)
+{
+  int64_t fileSize = 0;
+  if(!base::GetFileSize(path, &fileSize)) {
+    // file does not exist yet
+    return false;
+  }
+
+  if(static_cast<uint64_t>(fileSize) != contents.size()) {
+    return false;
+  }
+
+  if(contents.empty()) {
+    return true;
+  }
+
+  base::MemoryMappedFile mappedFile;
+  if(!mappedFile.Initialize(path)) {
+    LOG(WARNING)
+      << "unable to map file into memory: "
+      << path;
+    return false;
+  }
+
+  DCHECK_EQ(mappedFile.length(), contents.size());
+  return ContentHashOfBytes(mappedFile.data(), mappedFile.length())
+    == ContentHash(contents);
+}
+
+} // namespace
+
+std::string ContentHash(
+  base::StringPiece data)
+{
+  return ContentHashOfBytes(
+    reinterpret_cast<const unsigned char*>(data.data())
+    , data.size());
+}
+
+base::FilePath GeneratedFilePath(
+  const base::FilePath& outputDir
+  , const base::FilePath& sourceRoot
+  , const base::FilePath& sourceFile)
+{
+  DCHECK(sourceFile.IsAbsolute());
+  DCHECK(!sourceFile.ReferencesParent());
+
+  base::FilePath relativePath;
+  if(sourceRoot.empty()
+     || !sourceRoot.AppendRelativePath(sourceFile, &relativePath))
+  {
+    base::FilePath::StringType absolutePath = sourceFile.value();
+    absolutePath.erase(
+      0, absolutePath.find_first_not_of(base::FilePath::kSeparators));
+    relativePath
+      = base::FilePath{kExternalSourcesDir}.Append(absolutePath);
+  }
+
+  return outputDir.Append(
+    relativePath.value()
+    + kGeneratedFileSuffix
+    + sourceFile.Extension());
+}
+
+GeneratedFileWriter::GeneratedFileWriter(
+  const std::string& statsName)
+  : statsName_(statsName)
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+GeneratedFileWriter::~GeneratedFileWriter()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+bool GeneratedFileWriter::WriteIfChanged(
+  const base::FilePath& path
+  , base::StringPiece contents)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::GeneratedFileWriter::WriteIfChanged");
+
+  if(HasSameContents(path, contents)) {
+    VLOG(9)
+      << "skipped writing of unchanged file: "
+      << path;
+    skippedFiles_++;
+    return true;
+  }
+
+  if(!base::CreateDirectory(path.DirName())) {
+    LOG(ERROR)
+      << "unable to create directory: "
+      << path.DirName();
+    failedFiles_++;
+    return false;
+  }
+
+  /// \note writes to temporary file and renames it,
+  /// so other processes never observe partially written file
+  if(!base::ImportantFileWriter::WriteFileAtomically(path, contents)) {
+    LOG(ERROR)
+      << "unable to write file: "
+      << path;
+    failedFiles_++;
+    return false;
+  }
+
+  VLOG(9)
+    << "written file: "
+    << path;
+  writtenFiles_++;
+  return true;
+}
+
+bool GeneratedFileWriter::ReplaceIfChanged(
+  const base::FilePath& tempFile
+  , const base::FilePath& path)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::GeneratedFileWriter::ReplaceIfChanged");
+
+  if(base::PathExists(path) && base::ContentsEqual(tempFile, path)) {
+    VLOG(9)
+      << "skipped writing of unchanged file: "
+      << path;
+    base::DeleteFile(tempFile);
+    skippedFiles_++;
+    return true;
+  }
+
+  base::File::Error error = base::File::FILE_OK;
+  if(!base::CreateDirectory(path.DirName())
+     || !base::ReplaceFile(tempFile, path, &error))
+  {
+    LOG(ERROR)
+      << "unable to write file: "
+      << path
+      << " error: "
+      << base::File::ErrorToString(error);
+    base::DeleteFile(tempFile);
+    failedFiles_++;
+    return false;
+  }
+
+  VLOG(9)
+    << "written file: "
+    << path;
+  writtenFiles_++;
+  return true;
+}
+
+void GeneratedFileWriter::LogStats() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  LOG(INFO)
+    << statsName_
+    << " written: "
+    << writtenFiles_
+    << ", skipped as unchanged: "
+    << skippedFiles_
+    << ", failed: "
+    << failedFiles_;
+}
+
+} // namespace plugin
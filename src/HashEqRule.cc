@@ -0,0 +1,410 @@
+#include <flex_reflect_plugin/HashEqRule.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/EditApplier.hpp>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/DeclFriend.h>
+#include <clang/AST/RecordLayout.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+const char kMakeHashEqRule[] = "make_hash_eq";
+
+namespace {
+
+static const char* const kRequiredIncludes[] = {
+  "<cstddef>"
+  , "<cstdint>"
+  , "<functional>"
+  , "<iterator>"
+  , "<memory>"
+  , "<type_traits>"
+};
+
+// fields that are compared together
+struct FieldRun {
+  std::vector<const clang::FieldDecl*> fields;
+
+  // bytewise comparable fields without padding between them
+  bool isBytewise = false;
+
+  int64_t offset = 0;
+
+  int64_t size = 0;
+};
+
+static bool IsEqualityOrHash(
+  const clang::NamedDecl* decl)
+{
+  const clang::FunctionDecl* function = decl
+    ? decl->getAsFunction()
+    : nullptr;
+  if(!function) {
+    return false;
+  }
+  if(function->getOverloadedOperator() == clang::OO_EqualEqual) {
+    return true;
+  }
+  const clang::IdentifierInfo* identifier = function->getIdentifier();
+  return identifier && identifier->isStr("hash_value");
+}
+
+// returns true if |record| has user declared `operator==`
+// or `hash_value` (member, friend or in namespace of record)
+// or will get them from this rule
+static bool HasUserEqualityOrHash(
+  const clang::CXXRecordDecl* record)
+{
+  for(const clang::AnnotateAttr* annotateAttr
+        : record->specific_attrs<clang::AnnotateAttr>())
+  {
+    if(annotateAttr->getAnnotation().find(kMakeHashEqRule)
+       != llvm::StringRef::npos)
+    {
+      return true;
+    }
+  }
+  for(const clang::Decl* decl : record->decls()) {
+    if(const auto* friendDecl = llvm::dyn_cast<clang::FriendDecl>(decl)) {
+      if(IsEqualityOrHash(friendDecl->getFriendDecl())) {
+        return true;
+      }
+    } else if(IsEqualityOrHash(llvm::dyn_cast<clang::NamedDecl>(decl))) {
+      return true;
+    }
+  }
+  /// \note any declaration in namespace of record is counted,
+  /// so records are compared by their operators when in doubt
+  clang::ASTContext& context = record->getASTContext();
+  const clang::DeclContext* namespaceContext
+    = record->getDeclContext()->getRedeclContext();
+  const clang::DeclarationName names[] = {
+    context.DeclarationNames.getCXXOperatorName(clang::OO_EqualEqual)
+    , clang::DeclarationName(&context.Idents.get("hash_value"))
+  };
+  for(const clang::DeclarationName& name : names) {
+    if(!namespaceContext->lookup(name).empty()) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// returns true if |type| has no padding and equality of its values
+// is equality of their bytes
+static bool IsBytewiseType(
+  const clang::ASTContext& context
+  , clang::QualType type)
+{
+  /// \note floating point, padded records and references
+  /// have no unique object representation
+  if(type->isReferenceType()
+     || !context.hasUniqueObjectRepresentations(type))
+  {
+    return false;
+  }
+  if(const clang::ArrayType* arrayType = type->getAsArrayTypeUnsafe()) {
+    return IsBytewiseType(context, arrayType->getElementType());
+  }
+  if(type->isScalarType()) {
+    return true;
+  }
+  /// \note records with user declared `operator==` or `hash_value`
+  /// (also in their fields or bases) must be compared by that operators
+  const clang::CXXRecordDecl* record = type->getAsCXXRecordDecl();
+  if(!record || !record->hasDefinition()
+     || HasUserEqualityOrHash(record))
+  {
+    return false;
+  }
+  for(const clang::CXXBaseSpecifier& base : record->bases()) {
+    if(!IsBytewiseType(context, base.getType())) {
+      return false;
+    }
+  }
+  for(const clang::FieldDecl* field : record->fields()) {
+    if(field->isBitField() || !IsBytewiseType(context, field->getType())) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool IsBytewiseField(
+  const clang::ASTContext& context
+  , const clang::FieldDecl* field)
+{
+  return !field->isBitField()
+    && IsBytewiseType(context, field->getType());
+}
+
+// groups adjacent bytewise fields into runs
+static std::vector<FieldRun> CollectFieldRuns(
+  const clang::ASTContext& context
+  , const clang::CXXRecordDecl* record)
+{
+  const clang::ASTRecordLayout& layout
+    = context.getASTRecordLayout(record);
+
+  std::vector<FieldRun> runs;
+  for(const clang::FieldDecl* field : record->fields()) {
+    const int64_t offset
+      = context.toCharUnitsFromBits(
+          layout.getFieldOffset(field->getFieldIndex())).getQuantity();
+    const bool isBytewise = IsBytewiseField(context, field);
+    const int64_t size = isBytewise
+      ? context.getTypeSizeInChars(field->getType()).getQuantity()
+      : 0;
+
+    if(isBytewise && !runs.empty() && runs.back().isBytewise
+       && runs.back().offset + runs.back().size == offset)
+    {
+      runs.back().fields.push_back(field);
+      runs.back().size += size;
+      continue;
+    }
+
+    FieldRun run;
+    run.fields.push_back(field);
+    run.isBytewise = isBytewise;
+    run.offset = offset;
+    run.size = size;
+    runs.push_back(run);
+  }
+  return runs;
+}
+
+static std::string FieldNames(
+  const FieldRun& run)
+{
+  std::string names;
+  for(const clang::FieldDecl* field : run.fields) {
+    if(!names.empty()) {
+      names += ", ";
+    }
+    names += field->getName().str();
+  }
+  return names;
+}
+
+// returns empty string if record is not supported
+static std::string UnsupportedReason(
+  const clang::CXXRecordDecl* record)
+{
+  if(!record || !record->isThisDeclarationADefinition()) {
+    return "annotated declaration is not definition of struct or class";
+  }
+  if(record->isUnion()) {
+    return "unions are not supported";
+  }
+  if(record->isDependentType()) {
+    return "templates are not supported";
+  }
+  if(record->getNumBases() || record->getNumVBases()) {
+    return "records with base classes are not supported";
+  }
+  if(!record->getIdentifier()) {
+    return "anonymous records are not supported";
+  }
+  for(const clang::FieldDecl* field : record->fields()) {
+    if(field->getType()->isArrayType()
+       && !IsBytewiseField(record->getASTContext(), field))
+    {
+      return "array field " + field->getName().str()
+        + " can not be compared bytewise";
+    }
+    if(!field->getIdentifier()) {
+      return "anonymous fields are not supported";
+    }
+  }
+  return std::string{};
+}
+
+static std::string GenerateHashEq(
+  const std::string& recordName
+  , const std::vector<FieldRun>& runs)
+{
+  const std::string valueType = "const " + recordName + "&";
+
+  std::string equals;
+  std::string hash;
+  for(const FieldRun& run : runs) {
+    if(!equals.empty()) {
+      equals += "\n      && ";
+    }
+    if(run.isBytewise) {
+      const std::string offset = base::NumberToString(run.offset);
+      const std::string size = base::NumberToString(run.size);
+      equals += "__builtin_memcmp("
+        "reinterpret_cast<const unsigned char*>(std::addressof(lhs)) + "
+        + offset
+        + ", reinterpret_cast<const unsigned char*>(std::addressof(rhs)) + "
+        + offset
+        + ", " + size + ") == 0 /* " + FieldNames(run) + " */";
+      hash += "    seed = flexHashBytes("
+        "reinterpret_cast<const unsigned char*>(std::addressof(value)) + "
+        + offset
+        + ", " + size + ", seed); /* " + FieldNames(run) + " */\n";
+      continue;
+    }
+    DCHECK_EQ(1u, run.fields.size());
+    const std::string name = run.fields.front()->getName().str();
+    equals += "lhs." + name + " == rhs." + name;
+    hash += "    seed = flexHashCombine(seed"
+      ", flexHashField(value." + name + ", flexHashAdl{}));\n";
+  }
+  if(equals.empty()) {
+    equals = "true";
+  }
+
+  return
+    "\n"
+    "  // generated by " + std::string(kMakeHashEqRule) + "\n"
+    " public:\n"
+    "  friend bool operator==(" + valueType + " lhs"
+      ", " + valueType + " rhs) noexcept {\n"
+    "    return " + equals + ";\n"
+    "  }\n"
+    "\n"
+    "  friend bool operator!=(" + valueType + " lhs"
+      ", " + valueType + " rhs) noexcept {\n"
+    "    return !(lhs == rhs);\n"
+    "  }\n"
+    "\n"
+    "  friend std::size_t hash_value(" + valueType + " value) noexcept {\n"
+    "    std::size_t seed = 0;\n"
+    + hash +
+    "    return seed;\n"
+    "  }\n"
+    "\n"
+    "  struct Hasher {\n"
+    "    std::size_t operator()(" + valueType + " value) const noexcept {\n"
+    "      return hash_value(value);\n"
+    "    }\n"
+    "  };\n"
+    "\n"
+    " private:\n"
+    "  static std::size_t flexHashCombine(\n"
+    "    std::size_t seed, std::uint64_t word) noexcept {\n"
+    "    std::uint64_t mixed = (seed ^ word) * 0x9ddfea08eb382d69ULL;\n"
+    "    return static_cast<std::size_t>(mixed ^ (mixed >> 47));\n"
+    "  }\n"
+    "\n"
+    "  // hashes 8 bytes at once\n"
+    "  static std::size_t flexHashBytes(\n"
+    "    const unsigned char* data, std::size_t size\n"
+    "    , std::size_t seed) noexcept {\n"
+    "    std::size_t i = 0;\n"
+    "    for(; i + sizeof(std::uint64_t) <= size;"
+      " i += sizeof(std::uint64_t)) {\n"
+    "      std::uint64_t word;\n"
+    "      __builtin_memcpy(&word, data + i, sizeof(word));\n"
+    "      seed = flexHashCombine(seed, word);\n"
+    "    }\n"
+    "    if(i < size) {\n"
+    "      std::uint64_t word = 0;\n"
+    "      __builtin_memcpy(&word, data + i, size - i);\n"
+    "      seed = flexHashCombine(seed, word);\n"
+    "    }\n"
+    "    return seed;\n"
+    "  }\n"
+    "\n"
+    "  // overloads of flexHashField are tried from most specific\n"
+    "  struct flexHashFallback {};\n"
+    "  struct flexHashRange : flexHashFallback {};\n"
+    "  struct flexHashStd : flexHashRange {};\n"
+    "  struct flexHashAdl : flexHashStd {};\n"
+    "\n"
+    "  // customization point: hash_value found by ADL\n"
+    "  // (records generated by " + std::string(kMakeHashEqRule) + " etc.)\n"
+    "  template <typename T>\n"
+    "  static auto flexHashField(const T& field, flexHashAdl)\n"
+    "    -> decltype(static_cast<std::size_t>(hash_value(field))) {\n"
+    "    return static_cast<std::size_t>(hash_value(field));\n"
+    "  }\n"
+    "\n"
+    "  template <typename T>\n"
+    "  static auto flexHashField(const T& field, flexHashStd)\n"
+    "    -> decltype(static_cast<std::size_t>(std::hash<T>{}(field))) {\n"
+    "    return static_cast<std::size_t>(std::hash<T>{}(field));\n"
+    "  }\n"
+    "\n"
+    "  // containers and arrays are hashed element by element\n"
+    "  template <typename T>\n"
+    "  static auto flexHashField(const T& field, flexHashRange)\n"
+    "    -> decltype(std::begin(field), std::end(field), std::size_t{}) {\n"
+    "    std::size_t seed = 0;\n"
+    "    for(const auto& element : field) {\n"
+    "      seed = flexHashCombine(seed"
+      ", flexHashField(element, flexHashAdl{}));\n"
+    "    }\n"
+    "    return seed;\n"
+    "  }\n"
+    "\n"
+    "  template <typename T>\n"
+    "  static std::size_t flexHashField(const T&, flexHashFallback) {\n"
+    "    static_assert(sizeof(T) == 0\n"
+    "      , \"" + std::string(kMakeHashEqRule) + ": field type requires"
+      " hash_value found by ADL, std::hash or begin/end\");\n"
+    "    return 0;\n"
+    "  }\n";
+}
+
+} // namespace
+
+clang_utils::SourceTransformResult MakeHashEq(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::MakeHashEq");
+
+  const clang::CXXRecordDecl* record
+    = llvm::dyn_cast_or_null<clang::CXXRecordDecl>(
+        sourceTransformOptions.decl);
+
+  const std::string unsupportedReason = UnsupportedReason(record);
+  if(!unsupportedReason.empty()) {
+    LOG(ERROR)
+      << kMakeHashEqRule
+      << ": "
+      << unsupportedReason;
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  const std::vector<FieldRun> runs
+    = CollectFieldRuns(record->getASTContext(), record);
+
+  clang::Rewriter& rewriter = sourceTransformOptions.rewriter;
+  for(const char* header : kRequiredIncludes) {
+    AddIncludeOnce(rewriter, record, header);
+  }
+
+  // hidden friends are found only by ADL,
+  // so they do not slow down overload resolution of other types
+  rewriter.InsertTextBefore(
+    rewriter.getSourceMgr().getExpansionLoc(
+      record->getBraceRange().getEnd())
+    , GenerateHashEq(record->getName().str(), runs));
+
+  VLOG(9)
+    << kMakeHashEqRule
+    << ": generated for "
+    << record->getName().str()
+    << " using "
+    << runs.size()
+    << " field runs";
+
+  return clang_utils::SourceTransformResult{nullptr};
+}
+
+} // namespace plugin
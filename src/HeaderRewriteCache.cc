@@ -0,0 +1,467 @@
+#include <flex_reflect_plugin/HeaderRewriteCache.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/AnnotationMethods.hpp>
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp>
+#include <flex_reflect_plugin/DependencyTracker.hpp>
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp>
+#include <flex_reflect_plugin/version.hpp>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/files/file.h>
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
+#include <base/hash/hash.h>
+#include <base/stl_util.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_piece.h>
+#include <base/trace_event/trace_event.h>
+
+#include <set>
+#include <vector>
+
+namespace plugin {
+
+namespace {
+
+static const char kCacheEntryExtension[] = ".generated";
+
+// entry of header that was not rewritten by its annotations
+static const char kUnchangedEntryExtension[] = ".unchanged";
+
+// buffer with predefined and command line macros
+static const char kPredefinesBufferName[] = "<built-in>";
+
+// file to hash of declarations produced by file (kinds and offsets),
+// changes if preprocessor selects other parts of file
+using DeclFingerprints = std::map<clang::FileID, size_t>;
+
+struct HeaderAnnotations {
+  clang::FileID fileID;
+
+  std::vector<std::string> annotations;
+
+  std::set<base::FilePath> dependencies;
+
+  bool isCacheable = true;
+};
+
+class HeaderAnnotationsCollector
+  : public clang::RecursiveASTVisitor<HeaderAnnotationsCollector> {
+public:
+  HeaderAnnotationsCollector(
+    const clang::SourceManager& sourceManager
+    , TranslationUnitFileFilter& fileFilter
+    , std::map<base::FilePath, HeaderAnnotations>& headers
+    , DeclFingerprints& declFingerprints)
+    : sourceManager_(sourceManager)
+    , fileFilter_(fileFilter)
+    , headers_(headers)
+    , declFingerprints_(declFingerprints)
+  {}
+
+  // skips declarations of files without annotations
+  bool TraverseDecl(clang::Decl* decl)
+  {
+    if(!fileFilter_.ShouldTraverse(decl)) {
+      return true;
+    }
+    return RecursiveASTVisitor::TraverseDecl(decl);
+  }
+
+  bool VisitDecl(clang::Decl* decl)
+  {
+    // implicit declarations depend on usage in translation unit
+    if(!decl->isImplicit()) {
+      addDeclFingerprint(decl);
+    }
+
+    for(const clang::AnnotateAttr* annotateAttr
+          : decl->specific_attrs<clang::AnnotateAttr>())
+    {
+      const llvm::StringRef annotation = annotateAttr->getAnnotation();
+      if(!annotation.startswith(kGenPrefix)) {
+        continue;
+      }
+
+      const clang::SourceLocation loc
+        = sourceManager_.getExpansionLoc(decl->getBeginLoc());
+      const clang::FileID fileID = sourceManager_.getFileID(loc);
+      if(fileID == sourceManager_.getMainFileID()) {
+        continue;
+      }
+
+      const base::FilePath filePath
+        = FilePathOfLocation(sourceManager_, loc);
+      if(filePath.empty()) {
+        continue;
+      }
+
+      HeaderAnnotations& header = headers_[filePath];
+      header.fileID = fileID;
+      header.annotations.push_back(annotation.str());
+      CollectDeclDependencies(sourceManager_, decl, &header.dependencies);
+      // interpreted code of any method has side effects
+      // (declarations used by later snippets, state of host)
+      // that would be lost when header is restored from cache
+      if(!annotation.drop_front(base::size(kGenPrefix) - 1)
+            .startswith(kFunccallMethod))
+      {
+        header.isCacheable = false;
+      }
+    }
+    return true;
+  }
+
+private:
+  void addDeclFingerprint(const clang::Decl* decl)
+  {
+    const clang::SourceLocation loc
+      = sourceManager_.getExpansionLoc(decl->getLocation());
+    if(loc.isInvalid()) {
+      return;
+    }
+    const std::pair<clang::FileID, unsigned> decomposedLoc
+      = sourceManager_.getDecomposedLoc(loc);
+    size_t& fingerprint = declFingerprints_[decomposedLoc.first];
+    fingerprint = base::HashInts(
+      fingerprint
+      , base::HashInts(decl->getKind(), decomposedLoc.second));
+  }
+
+private:
+  const clang::SourceManager& sourceManager_;
+
+  TranslationUnitFileFilter& fileFilter_;
+
+  std::map<base::FilePath, HeaderAnnotations>& headers_;
+
+  DeclFingerprints& declFingerprints_;
+};
+
+// hash of predefined and command line macros (`-D`)
+static std::string PredefinesHash(
+  const clang::SourceManager& sourceManager)
+{
+  for(unsigned i = 0; i < sourceManager.local_sloc_entry_size(); i++) {
+    const clang::SrcMgr::SLocEntry& entry
+      = sourceManager.getLocalSLocEntry(i);
+    if(!entry.isFile()) {
+      continue;
+    }
+    const clang::SourceLocation loc
+      = clang::SourceLocation::getFromRawEncoding(entry.getOffset());
+    if(sourceManager.getBufferName(loc) != kPredefinesBufferName) {
+      continue;
+    }
+    const llvm::StringRef predefines
+      = sourceManager.getBufferData(sourceManager.getFileID(loc));
+    return ContentHash(
+      base::StringPiece(predefines.data(), predefines.size()));
+  }
+  return std::string{};
+}
+
+// file to hash of macro definitions expanded in that file
+// (including macros expanded by other macros),
+// macro defined differently before `#include` changes hash
+static std::map<clang::FileID, size_t> MacroFingerprints(
+  const clang::SourceManager& sourceManager
+  , const std::set<clang::FileID>& files)
+{
+  std::map<clang::FileID, size_t> fingerprints;
+  const unsigned entryCount = sourceManager.local_sloc_entry_size();
+  for(unsigned i = 0; i < entryCount; i++) {
+    const clang::SrcMgr::SLocEntry& entry
+      = sourceManager.getLocalSLocEntry(i);
+    if(!entry.isExpansion()) {
+      continue;
+    }
+
+    const clang::SrcMgr::ExpansionInfo& expansion = entry.getExpansion();
+    if(expansion.isMacroArgExpansion()) {
+      continue;
+    }
+
+    const std::pair<clang::FileID, unsigned> expandedAt
+      = sourceManager.getDecomposedLoc(
+          sourceManager.getExpansionLoc(expansion.getExpansionLocStart()));
+    if(!files.count(expandedAt.first)) {
+      continue;
+    }
+
+    // expansion entry spans text of macro body
+    const clang::SourceLocation bodyLoc
+      = sourceManager.getSpellingLoc(expansion.getSpellingLoc());
+    // tokens created by `##` have no stable location
+    if(bodyLoc.isInvalid()
+       || sourceManager.isWrittenInScratchSpace(bodyLoc))
+    {
+      continue;
+    }
+    const unsigned nextOffset = i + 1 < entryCount
+      ? sourceManager.getLocalSLocEntry(i + 1).getOffset()
+      : sourceManager.getNextLocalOffset();
+    bool isInvalid = false;
+    const char* body = sourceManager.getCharacterData(bodyLoc, &isInvalid);
+    if(isInvalid) {
+      continue;
+    }
+
+    size_t& fingerprint = fingerprints[expandedAt.first];
+    fingerprint = base::HashInts(
+      fingerprint
+      , base::HashInts(
+          expandedAt.second
+          , base::PersistentHash(
+              body, nextOffset - entry.getOffset() - 1)));
+  }
+  return fingerprints;
+}
+
+} // namespace
+
+std::map<clang::FileID, size_t> RewriteBufferSignatures(
+  const clang::Rewriter& rewriter)
+{
+  std::map<clang::FileID, size_t> signatures;
+  for(auto it = rewriter.buffer_begin(); it != rewriter.buffer_end(); ++it)
+  {
+    size_t& signature = signatures[it->first];
+
+    // any edit splits pieces or adds piece with new text
+    const clang::RewriteBuffer& buffer = it->second;
+    for(auto piece = buffer.begin(); piece != buffer.end();
+        piece.MoveToNextPiece())
+    {
+      const llvm::StringRef text = piece.piece();
+      signature = base::HashInts(
+        signature
+        , base::HashInts(
+            reinterpret_cast<uintptr_t>(text.data())
+            , text.size()));
+    }
+  }
+  return signatures;
+}
+
+ScopedHeaderCacheCheck::ScopedHeaderCacheCheck(
+  const clang::Rewriter& rewriter
+  , clang::FileID annotatedFile
+  , DisableCacheCallback disableCache)
+  : rewriter_(rewriter)
+  , annotatedFile_(annotatedFile)
+  , signatures_(RewriteBufferSignatures(rewriter))
+  , disableCache_(std::move(disableCache))
+{
+  DCHECK(disableCache_);
+}
+
+ScopedHeaderCacheCheck::~ScopedHeaderCacheCheck()
+{
+  bool hasForeignEdits = false;
+  for(const auto& it : RewriteBufferSignatures(rewriter_)) {
+    if(it.first == annotatedFile_) {
+      continue;
+    }
+    auto before = signatures_.find(it.first);
+    if(before == signatures_.end() || before->second != it.second) {
+      hasForeignEdits = true;
+      disableCache_.Run(it.first);
+    }
+  }
+
+  if(!succeeded_ || hasForeignEdits) {
+    disableCache_.Run(annotatedFile_);
+  }
+}
+
+HeaderRewriteCache::HeaderRewriteCache(
+  const base::FilePath& cacheDir)
+  : cacheDir_(cacheDir)
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+HeaderRewriteCache::~HeaderRewriteCache()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+std::map<base::FilePath, HeaderRewriteCache::HeaderKey>
+  HeaderRewriteCache::ComputeHeaderKeys(
+    clang::ASTContext& context
+    , const std::string& ruleSet
+    , AnnotationPrescanner* prescanner) const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::HeaderRewriteCache::ComputeHeaderKeys");
+
+  const clang::SourceManager& sourceManager = context.getSourceManager();
+
+  std::map<base::FilePath, HeaderAnnotations> headers;
+  DeclFingerprints declFingerprints;
+  {
+    TranslationUnitFileFilter fileFilter(prescanner, sourceManager);
+    HeaderAnnotationsCollector collector(
+      sourceManager, fileFilter, headers, declFingerprints);
+    collector.TraverseDecl(context.getTranslationUnitDecl());
+  }
+
+  if(headers.empty()) {
+    return std::map<base::FilePath, HeaderKey>{};
+  }
+
+  // preprocessor state of translation unit that affects headers
+  const std::string predefinesHash = PredefinesHash(sourceManager);
+  std::set<clang::FileID> headerFiles;
+  for(const auto& it : headers) {
+    headerFiles.insert(it.second.fileID);
+  }
+  std::map<clang::FileID, size_t> macroFingerprints
+    = MacroFingerprints(sourceManager, headerFiles);
+
+  std::map<base::FilePath, HeaderKey> keys;
+  for(const auto& it : headers) {
+    const HeaderAnnotations& header = it.second;
+    if(!header.isCacheable) {
+      VLOG(9)
+        << "header uses interpreted code and will not be cached: "
+        << it.first;
+      continue;
+    }
+
+    bool isInvalid = false;
+    const llvm::StringRef contents
+      = sourceManager.getBufferData(header.fileID, &isInvalid);
+    if(isInvalid) {
+      continue;
+    }
+
+    std::string keySource;
+    keySource += FLEX_REFLECT_VERSION;
+    keySource += '\0';
+    keySource += ruleSet;
+    keySource += '\0';
+    keySource += it.first.value();
+    keySource += '\0';
+    keySource += ContentHash(
+      base::StringPiece(contents.data(), contents.size()));
+    for(const std::string& annotation : header.annotations) {
+      keySource += '\0';
+      keySource += annotation;
+    }
+    // same header may be preprocessed differently
+    // depending on macros defined before `#include`
+    keySource += '\0';
+    keySource += predefinesHash;
+    keySource += '\0';
+    keySource += base::NumberToString(macroFingerprints[header.fileID]);
+    keySource += ':';
+    keySource += base::NumberToString(declFingerprints[header.fileID]);
+    // generated code depends on referenced types,
+    // so any change of their headers invalidates entry
+    for(const base::FilePath& dependency : header.dependencies) {
+      base::File::Info fileInfo;
+      if(dependency == it.first
+         || !base::GetFileInfo(dependency, &fileInfo))
+      {
+        continue;
+      }
+      keySource += '\0';
+      keySource += dependency.value();
+      keySource += ':';
+      keySource += base::NumberToString(fileInfo.size);
+      keySource += ':';
+      keySource += base::NumberToString(
+        fileInfo.last_modified.ToDeltaSinceWindowsEpoch().InMicroseconds());
+    }
+
+    HeaderKey& headerKey = keys[it.first];
+    headerKey.key = ContentHash(keySource);
+    headerKey.dependencies = header.dependencies;
+  }
+
+  return keys;
+}
+
+base::FilePath HeaderRewriteCache::entryPath(
+  const std::string& key
+  , const char* extension) const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  return cacheDir_.Append(key + extension);
+}
+
+bool HeaderRewriteCache::Lookup(
+  const std::string& key
+  , base::Optional<std::string>* contents)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::HeaderRewriteCache::Lookup");
+
+  DCHECK(contents);
+
+  if(base::PathExists(entryPath(key, kUnchangedEntryExtension))) {
+    hits_++;
+    *contents = base::nullopt;
+    return true;
+  }
+
+  std::string rewritten;
+  if(!base::ReadFileToString(
+        entryPath(key, kCacheEntryExtension), &rewritten))
+  {
+    misses_++;
+    return false;
+  }
+
+  hits_++;
+  *contents = std::move(rewritten);
+  return true;
+}
+
+void HeaderRewriteCache::Store(
+  const std::string& key
+  , const base::Optional<std::string>& contents)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::HeaderRewriteCache::Store");
+
+  const base::FilePath path = entryPath(
+    key
+    , contents ? kCacheEntryExtension : kUnchangedEntryExtension);
+
+  /// \note concurrent processes may store same key,
+  /// atomic rename guarantees that readers never observe partial entry
+  if(!base::CreateDirectory(cacheDir_)
+     || !base::ImportantFileWriter::WriteFileAtomically(
+          path, contents ? *contents : std::string{}))
+  {
+    LOG(WARNING)
+      << "unable to store header rewrite cache entry: "
+      << path;
+  }
+}
+
+void HeaderRewriteCache::LogStats() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  LOG(INFO)
+    << "header rewrite cache hits: "
+    << hits_
+    << ", misses: "
+    << misses_;
+}
+
+} // namespace plugin
@@ -0,0 +1,517 @@
+#include <flex_reflect_plugin/PooledRule.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/EditApplier.hpp>
+
+#include <flexlib/funcParser.hpp>
+
+#include <clang/AST/DeclCXX.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_util.h>
+#include <base/trace_event/trace_event.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+const char kMakePooledRule[] = "make_pooled";
+
+namespace {
+
+static const char* const kRequiredIncludes[] = {
+  "<atomic>"
+  , "<cstddef>"
+  , "<cstdint>"
+  , "<mutex>"
+  , "<new>"
+};
+
+static const char kSlabObjectsArg[] = "slab_objects";
+
+static const char kThreadCacheArg[] = "thread_cache";
+
+static const char kThreadCacheObjectsArg[] = "thread_cache_objects";
+
+static const size_t kDefaultSlabObjects = 256;
+
+static const size_t kDefaultThreadCacheObjects = 64;
+
+// $1 - class name, $2 - objects per slab
+static const char kPoolPrologue[] = R"raw(
+  // generated by make_pooled
+ public:
+  static void* operator new(std::size_t size) {
+    // derived classes use global allocator
+    if(size != sizeof($1)) {
+      return ::operator new(size);
+    }
+    void* ptr = flexPoolAllocate();
+    return ptr ? ptr : flexPoolAllocateSlot();
+  }
+
+  static void* operator new(std::size_t size, std::align_val_t align) {
+    if(!flexPoolIsSlot(size, align)) {
+      return ::operator new(size, align);
+    }
+    void* ptr = flexPoolAllocate();
+    return ptr ? ptr : flexPoolAllocateSlot();
+  }
+
+  static void* operator new(
+    std::size_t size, const std::nothrow_t&) noexcept {
+    if(size != sizeof($1)) {
+      return ::operator new(size, std::nothrow);
+    }
+    return flexPoolAllocate();
+  }
+
+  static void* operator new(
+    std::size_t size, std::align_val_t align
+    , const std::nothrow_t&) noexcept {
+    if(!flexPoolIsSlot(size, align)) {
+      return ::operator new(size, align, std::nothrow);
+    }
+    return flexPoolAllocate();
+  }
+
+  // class scope operator new hides global placement new
+  static void* operator new(std::size_t size, void* place) noexcept {
+    return ::operator new(size, place);
+  }
+
+  static void operator delete(void* ptr, std::size_t size) noexcept {
+    if(!ptr) {
+      return;
+    }
+    if(size != sizeof($1)) {
+      ::operator delete(ptr);
+      return;
+    }
+    flexPoolDeallocate(ptr);
+  }
+
+  static void operator delete(
+    void* ptr, std::size_t size, std::align_val_t align) noexcept {
+    if(!ptr) {
+      return;
+    }
+    if(!flexPoolIsSlot(size, align)) {
+      ::operator delete(ptr, align);
+      return;
+    }
+    flexPoolDeallocate(ptr);
+  }
+
+  // called only if constructor throws,
+  // size is unknown (may be derived class), so slabs are searched
+  static void operator delete(
+    void* ptr, const std::nothrow_t&) noexcept {
+    if(flexPoolOwns(ptr)) {
+      flexPoolDeallocate(ptr);
+      return;
+    }
+    ::operator delete(ptr);
+  }
+
+  static void operator delete(
+    void* ptr, std::align_val_t align, const std::nothrow_t&) noexcept {
+    if(flexPoolOwns(ptr)) {
+      flexPoolDeallocate(ptr);
+      return;
+    }
+    ::operator delete(ptr, align);
+  }
+
+  static void operator delete(void* ptr, void* place) noexcept {
+    ::operator delete(ptr, place);
+  }
+
+  struct PoolStats {
+    std::uint64_t allocations;
+    std::uint64_t deallocations;
+    std::uint64_t slabs;
+  };
+
+  static PoolStats poolStats() noexcept {
+    FlexPoolState& state = flexPoolState();
+    return PoolStats{
+      state.allocations.load(std::memory_order_relaxed)
+      , state.deallocations.load(std::memory_order_relaxed)
+      , state.slabs.load(std::memory_order_relaxed)};
+  }
+
+ private:
+  struct FlexPoolNode {
+    FlexPoolNode* next;
+  };
+
+  // first slot of slab
+  struct FlexPoolSlab {
+    FlexPoolSlab* next;
+  };
+
+  struct FlexPoolState {
+    std::mutex mutex;
+    FlexPoolNode* freeList = nullptr;
+    FlexPoolSlab* slabList = nullptr;
+    std::atomic<std::uint64_t> allocations{0};
+    std::atomic<std::uint64_t> deallocations{0};
+    std::atomic<std::uint64_t> slabs{0};
+  };
+
+  // never destroyed, so objects may be freed during exit
+  static FlexPoolState& flexPoolState() noexcept {
+    static FlexPoolState* state = new FlexPoolState;
+    return *state;
+  }
+
+  static constexpr std::size_t flexPoolSlotAlign() noexcept {
+    return alignof($1) > alignof(FlexPoolNode)
+      ? alignof($1) : alignof(FlexPoolNode);
+  }
+
+  // exact size of object (slot must also fit freelist link)
+  static constexpr std::size_t flexPoolSlotSize() noexcept {
+    return ((sizeof($1) > sizeof(FlexPoolNode)
+              ? sizeof($1) : sizeof(FlexPoolNode))
+            + flexPoolSlotAlign() - 1)
+      / flexPoolSlotAlign() * flexPoolSlotAlign();
+  }
+
+  // objects of other size or alignment use global allocator
+  static constexpr bool flexPoolIsSlot(
+    std::size_t size, std::align_val_t align) noexcept {
+    return size == sizeof($1)
+      && static_cast<std::size_t>(align) <= flexPoolSlotAlign();
+  }
+
+  // slot allocated by throwing operator new
+  // when slab can not be allocated, it joins pool when freed
+  static void* flexPoolAllocateSlot() {
+    void* ptr = ::operator new(flexPoolSlotSize()
+                               , std::align_val_t{flexPoolSlotAlign()});
+    flexPoolState().allocations.fetch_add(1, std::memory_order_relaxed);
+    return ptr;
+  }
+
+  // counts only successful allocations
+  static void* flexPoolAllocate() noexcept {
+    void* ptr = flexPoolTake();
+    if(ptr) {
+      flexPoolState().allocations.fetch_add(1, std::memory_order_relaxed);
+    }
+    return ptr;
+  }
+
+  static constexpr std::size_t kFlexPoolSlabObjects = $2;
+
+  // slab starts with link to other slabs
+  static constexpr std::size_t flexPoolSlabSize() noexcept {
+    return flexPoolSlotSize() * (kFlexPoolSlabObjects + 1);
+  }
+
+  static bool flexPoolOwns(const void* ptr) noexcept {
+    FlexPoolState& state = flexPoolState();
+    const std::uintptr_t address = reinterpret_cast<std::uintptr_t>(ptr);
+    std::lock_guard<std::mutex> lock(state.mutex);
+    for(FlexPoolSlab* slab = state.slabList; slab; slab = slab->next) {
+      const std::uintptr_t begin = reinterpret_cast<std::uintptr_t>(slab);
+      if(address >= begin && address < begin + flexPoolSlabSize()) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // called with locked |state.mutex|,
+  // returns false if slab can not be allocated
+  static bool flexPoolAddSlab(FlexPoolState& state) noexcept {
+    unsigned char* slab = static_cast<unsigned char*>(
+      ::operator new(flexPoolSlabSize()
+                     , std::align_val_t{flexPoolSlotAlign()}
+                     , std::nothrow));
+    if(!slab) {
+      return false;
+    }
+    FlexPoolSlab* slabLink = reinterpret_cast<FlexPoolSlab*>(slab);
+    slabLink->next = state.slabList;
+    state.slabList = slabLink;
+    state.slabs.fetch_add(1, std::memory_order_relaxed);
+    for(std::size_t i = kFlexPoolSlabObjects; i > 0; i--) {
+      FlexPoolNode* node
+        = reinterpret_cast<FlexPoolNode*>(slab + i * flexPoolSlotSize());
+      node->next = state.freeList;
+      state.freeList = node;
+    }
+    return true;
+  }
+
+  // returns null if pool is empty and slab can not be allocated
+  static void* flexPoolAllocateShared(FlexPoolState& state) noexcept {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    if(!state.freeList && !flexPoolAddSlab(state)) {
+      return nullptr;
+    }
+    FlexPoolNode* node = state.freeList;
+    state.freeList = node->next;
+    return node;
+  }
+
+  static void flexPoolDeallocateShared(
+    FlexPoolState& state, FlexPoolNode* node) noexcept {
+    std::lock_guard<std::mutex> lock(state.mutex);
+    node->next = state.freeList;
+    state.freeList = node;
+  }
+)raw";
+
+static const char kPoolWithoutCache[] = R"raw(
+  static void* flexPoolTake() noexcept {
+    return flexPoolAllocateShared(flexPoolState());
+  }
+
+  static void flexPoolDeallocate(void* ptr) noexcept {
+    FlexPoolState& state = flexPoolState();
+    state.deallocations.fetch_add(1, std::memory_order_relaxed);
+    flexPoolDeallocateShared(state, static_cast<FlexPoolNode*>(ptr));
+  }
+)raw";
+
+// $1 - limit of thread local cache
+static const char kPoolWithCache[] = R"raw(
+  static constexpr std::size_t kFlexPoolCacheObjects = $1;
+
+  struct FlexPoolCache {
+    FlexPoolNode* freeList = nullptr;
+    std::size_t size = 0;
+
+    // objects cached by finished thread are returned to pool
+    ~FlexPoolCache() {
+      FlexPoolState& state = flexPoolState();
+      std::lock_guard<std::mutex> lock(state.mutex);
+      while(freeList) {
+        FlexPoolNode* node = freeList;
+        freeList = node->next;
+        node->next = state.freeList;
+        state.freeList = node;
+      }
+      flexPoolCacheDestroyed() = true;
+    }
+  };
+
+  // trivially destructible, so it stays valid
+  // while destructors of other thread local objects run
+  static bool& flexPoolCacheDestroyed() noexcept {
+    static thread_local bool destroyed = false;
+    return destroyed;
+  }
+
+  // null after cache of exiting thread is destroyed,
+  // then objects are taken from and returned to shared pool
+  static FlexPoolCache* flexPoolCache() noexcept {
+    if(flexPoolCacheDestroyed()) {
+      return nullptr;
+    }
+    static thread_local FlexPoolCache cache;
+    return &cache;
+  }
+
+  static void* flexPoolTake() noexcept {
+    FlexPoolState& state = flexPoolState();
+    FlexPoolCache* cache = flexPoolCache();
+    if(!cache) {
+      return flexPoolAllocateShared(state);
+    }
+    if(!cache->freeList) {
+      // refill half of cache using single lock
+      std::lock_guard<std::mutex> lock(state.mutex);
+      while(cache->size < kFlexPoolCacheObjects / 2 + 1) {
+        if(!state.freeList && !flexPoolAddSlab(state)) {
+          break;
+        }
+        FlexPoolNode* node = state.freeList;
+        state.freeList = node->next;
+        node->next = cache->freeList;
+        cache->freeList = node;
+        cache->size++;
+      }
+      if(!cache->freeList) {
+        return nullptr;
+      }
+    }
+    FlexPoolNode* node = cache->freeList;
+    cache->freeList = node->next;
+    cache->size--;
+    return node;
+  }
+
+  static void flexPoolDeallocate(void* ptr) noexcept {
+    FlexPoolState& state = flexPoolState();
+    state.deallocations.fetch_add(1, std::memory_order_relaxed);
+    FlexPoolNode* node = static_cast<FlexPoolNode*>(ptr);
+    FlexPoolCache* cache = flexPoolCache();
+    if(cache && cache->size < kFlexPoolCacheObjects) {
+      node->next = cache->freeList;
+      cache->freeList = node;
+      cache->size++;
+      return;
+    }
+    flexPoolDeallocateShared(state, node);
+  }
+)raw";
+
+struct PoolOptions {
+  size_t slabObjects = kDefaultSlabObjects;
+
+  bool threadCache = false;
+
+  size_t threadCacheObjects = kDefaultThreadCacheObjects;
+};
+
+// returns false if arguments of rule are invalid,
+// arguments are already split by `flexlib::split_to_funcs`
+static bool ParsePoolOptions(
+  const ::flexlib::parsed_func& func
+  , PoolOptions* options)
+{
+  for(const auto& arg : func.parsed_func_.args_.as_vec_) {
+    const std::string& name = arg.name_;
+    const std::string& value = arg.value_;
+    if(name == kSlabObjectsArg) {
+      if(!base::StringToSizeT(value, &options->slabObjects)
+         || !options->slabObjects)
+      {
+        LOG(ERROR)
+          << kMakePooledRule
+          << ": invalid "
+          << kSlabObjectsArg
+          << ": "
+          << value;
+        return false;
+      }
+    } else if(name == kThreadCacheArg) {
+      if(value != "true" && value != "false") {
+        LOG(ERROR)
+          << kMakePooledRule
+          << ": "
+          << kThreadCacheArg
+          << " must be true or false: "
+          << value;
+        return false;
+      }
+      options->threadCache = value == "true";
+    } else if(name == kThreadCacheObjectsArg) {
+      if(!base::StringToSizeT(value, &options->threadCacheObjects)
+         || !options->threadCacheObjects)
+      {
+        LOG(ERROR)
+          << kMakePooledRule
+          << ": invalid "
+          << kThreadCacheObjectsArg
+          << ": "
+          << value;
+        return false;
+      }
+    } else {
+      LOG(ERROR)
+        << kMakePooledRule
+        << ": unknown argument: "
+        << name
+        << "="
+        << value;
+      return false;
+    }
+  }
+  return true;
+}
+
+// returns empty string if record is supported
+static std::string UnsupportedReason(
+  const clang::CXXRecordDecl* record)
+{
+  if(!record || !record->isThisDeclarationADefinition()) {
+    return "annotated declaration is not definition of struct or class";
+  }
+  if(!record->getIdentifier()) {
+    return "anonymous records are not supported";
+  }
+  for(const clang::Decl* decl : record->decls()) {
+    const clang::FunctionDecl* function = decl->getAsFunction();
+    if(!function) {
+      continue;
+    }
+    const clang::OverloadedOperatorKind kind
+      = function->getOverloadedOperator();
+    if(kind == clang::OO_New || kind == clang::OO_Delete) {
+      return "class already declares operator new or operator delete";
+    }
+  }
+  return std::string{};
+}
+
+} // namespace
+
+clang_utils::SourceTransformResult MakePooled(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::MakePooled");
+
+  const clang::CXXRecordDecl* record
+    = llvm::dyn_cast_or_null<clang::CXXRecordDecl>(
+        sourceTransformOptions.decl);
+
+  const std::string unsupportedReason = UnsupportedReason(record);
+  if(!unsupportedReason.empty()) {
+    LOG(ERROR)
+      << kMakePooledRule
+      << ": "
+      << unsupportedReason;
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  PoolOptions options;
+  if(!ParsePoolOptions(sourceTransformOptions.func_with_args, &options))
+  {
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  const std::string recordName = record->getName().str();
+  std::string code
+    = base::ReplaceStringPlaceholders(
+        kPoolPrologue
+        , {recordName, base::NumberToString(options.slabObjects)}
+        , nullptr);
+  code += options.threadCache
+    ? base::ReplaceStringPlaceholders(
+        kPoolWithCache
+        , {base::NumberToString(options.threadCacheObjects)}
+        , nullptr)
+    : std::string(kPoolWithoutCache);
+
+  clang::Rewriter& rewriter = sourceTransformOptions.rewriter;
+  for(const char* header : kRequiredIncludes) {
+    AddIncludeOnce(rewriter, record, header);
+  }
+
+  rewriter.InsertTextBefore(
+    rewriter.getSourceMgr().getExpansionLoc(
+      record->getBraceRange().getEnd())
+    , code);
+
+  VLOG(9)
+    << kMakePooledRule
+    << ": generated for "
+    << recordName
+    << " with "
+    << options.slabObjects
+    << " objects per slab"
+    << (options.threadCache ? " and thread local cache" : "");
+
+  return clang_utils::SourceTransformResult{nullptr};
+}
+
+} // namespace plugin
@@ -0,0 +1,115 @@
+#include <flex_reflect_plugin/RuleChain.hpp> // IWYU pragma: associated
+
+#include <base/barrier_closure.h>
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/synchronization/waitable_event.h>
+#include <base/trace_event/trace_event.h>
+
+#include <memory>
+#include <utility>
+
+namespace plugin {
+
+namespace {
+
+class StepTask
+  : public base::DelegateSimpleThread::Delegate {
+public:
+  // |done| is called after rule returned
+  StepTask(
+    const base::RepeatingClosure& runRule
+    , const base::RepeatingClosure& done)
+    : runRule_(runRule)
+    , done_(done)
+  {}
+
+  void Run() override
+  {
+    runRule_.Run();
+    done_.Run();
+  }
+
+private:
+  const base::RepeatingClosure& runRule_;
+
+  const base::RepeatingClosure& done_;
+
+  DISALLOW_COPY_AND_ASSIGN(StepTask);
+};
+
+} // namespace
+
+RuleChain::RuleChain(
+  base::DelegateSimpleThreadPool* pool)
+  : pool_(pool)
+{}
+
+RuleChain::~RuleChain()
+{}
+
+void RuleChain::AddStep(
+  Step step)
+{
+  DCHECK(step.runRule);
+  DCHECK(step.applyResult);
+  steps_.push_back(std::move(step));
+}
+
+void RuleChain::Run(
+  const base::RepeatingClosure& beforeConcurrentRun)
+{
+  for(size_t first = 0; first < steps_.size(); ) {
+    size_t last = first + 1;
+    if(steps_[first].isPure) {
+      while(last < steps_.size() && steps_[last].isPure) {
+        last++;
+      }
+    }
+
+    // rule may read rewriter, so result of each rule
+    // is applied before next rule runs
+    if(!pool_ || last - first == 1) {
+      for(size_t i = first; i < last; i++) {
+        steps_[i].runRule.Run();
+        std::move(steps_[i].applyResult).Run();
+      }
+      first = last;
+      continue;
+    }
+
+    {
+      TRACE_EVENT1("toplevel",
+                   "plugin::FlexReflect::runPureRules",
+                   "rules", last - first);
+
+      if(beforeConcurrentRun) {
+        beforeConcurrentRun.Run();
+      }
+
+      base::WaitableEvent tasksDone;
+      const base::RepeatingClosure taskDone = base::BarrierClosure(
+        last - first
+        , base::BindOnce(
+            &base::WaitableEvent::Signal
+            , base::Unretained(&tasksDone)));
+
+      std::vector<std::unique_ptr<StepTask>> tasks;
+      for(size_t i = first; i < last; i++) {
+        tasks.push_back(std::make_unique<StepTask>(
+          steps_[i].runRule, taskDone));
+        pool_->AddWork(tasks.back().get());
+      }
+      tasksDone.Wait();
+    }
+
+    // pure rules do not read rewriter,
+    // so results are applied in order of declaration
+    for(size_t i = first; i < last; i++) {
+      std::move(steps_[i].applyResult).Run();
+    }
+    first = last;
+  }
+}
+
+} // namespace plugin
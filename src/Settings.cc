@@ -0,0 +1,167 @@
+#include <flex_reflect_plugin/Settings.hpp> // IWYU pragma: associated
+
+#include <Corrade/Utility/ConfigurationGroup.h>
+
+#include <base/logging.h>
+#include <base/strings/string_split.h>
+#include <base/system/sys_info.h>
+
+#include <algorithm>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+static const std::string kOutputDirKey = "output_dir";
+
+static const std::string kSourceRootKey = "source_root";
+
+static const std::string kEmitDepfilesKey = "emit_depfiles";
+
+static const std::string kHeaderCacheDirKey = "header_cache_dir";
+
+static const std::string kPrescanAnnotationsKey = "prescan_annotations";
+
+static const std::string kInterpreterArgsKey = "interpreter_args";
+
+static const std::string kInterpreterIncludeDirsKey
+  = "interpreter_include_dirs";
+
+static const std::string kPrevalidateSnippetsKey = "prevalidate_snippets";
+
+static const std::string kPrevalidationArgsKey = "prevalidation_args";
+
+static const std::string kPrevalidationThreadsKey = "prevalidation_threads";
+
+static const std::string kPureRulesKey = "pure_rules";
+
+static const std::string kRuleThreadsKey = "rule_threads";
+
+static const std::string kSnippetBudgetKey = "snippet_budget_ms";
+
+static const std::string kTranslationUnitBudgetKey = "tu_budget_ms";
+
+static const std::string kAbortOverBudgetKey = "abort_over_budget";
+
+static const std::string kSlowSnippetLogKey = "slow_snippet_log";
+
+static const std::string kSlowSnippetThresholdKey = "slow_snippet_ms";
+
+// zero or missing value means "use all processors"
+static int ThreadsFromValue(int value)
+{
+  return value > 0
+    ? value
+    : base::SysInfo::NumberOfProcessors();
+}
+
+} // namespace
+
+// static
+FlexReflectSettings FlexReflectSettings::FromConfiguration(
+  const ::Corrade::Utility::ConfigurationGroup& configuration)
+{
+  FlexReflectSettings settings;
+
+  const std::string outputDir
+    = configuration.value(kOutputDirKey);
+  if(!outputDir.empty()) {
+    settings.outputDir = base::FilePath{outputDir};
+    VLOG(9)
+      << "plugin output directory: "
+      << settings.outputDir;
+  }
+
+  const std::string sourceRoot
+    = configuration.value(kSourceRootKey);
+  if(!sourceRoot.empty()) {
+    settings.sourceRoot = base::FilePath{sourceRoot};
+  }
+
+  settings.emitDepfiles
+    = configuration.value<bool>(kEmitDepfilesKey);
+  LOG_IF(WARNING, settings.emitDepfiles && settings.outputDir.empty())
+    << kEmitDepfilesKey
+    << " requires "
+    << kOutputDirKey;
+
+  const std::string headerCacheDir
+    = configuration.value(kHeaderCacheDirKey);
+  if(!headerCacheDir.empty()) {
+    settings.headerCacheDir = base::FilePath{headerCacheDir};
+  }
+  LOG_IF(WARNING
+         , !settings.headerCacheDir.empty() && settings.outputDir.empty())
+    << kHeaderCacheDirKey
+    << " requires "
+    << kOutputDirKey;
+
+  settings.prescanAnnotations
+    = configuration.value<bool>(kPrescanAnnotationsKey);
+
+  settings.interpreterArgs
+    = base::SplitString(
+        configuration.value(kInterpreterArgsKey)
+        , base::kWhitespaceASCII
+        , base::TRIM_WHITESPACE
+        , base::SPLIT_WANT_NONEMPTY);
+
+  settings.interpreterIncludeDirs
+    = base::SplitString(
+        configuration.value(kInterpreterIncludeDirsKey)
+        , base::kWhitespaceASCII
+        , base::TRIM_WHITESPACE
+        , base::SPLIT_WANT_NONEMPTY);
+
+  settings.prevalidateSnippets
+    = configuration.value<bool>(kPrevalidateSnippetsKey);
+
+  settings.prevalidationArgs
+    = base::SplitString(
+        configuration.value(kPrevalidationArgsKey)
+        , base::kWhitespaceASCII
+        , base::TRIM_WHITESPACE
+        , base::SPLIT_WANT_NONEMPTY);
+
+  settings.prevalidationThreads
+    = ThreadsFromValue(configuration.value<int>(kPrevalidationThreadsKey));
+
+  for(const std::string& rule
+        : base::SplitString(
+            configuration.value(kPureRulesKey)
+            , ", \t"
+            , base::TRIM_WHITESPACE
+            , base::SPLIT_WANT_NONEMPTY))
+  {
+    settings.pureRules.insert(rule);
+  }
+
+  settings.ruleThreads
+    = ThreadsFromValue(configuration.value<int>(kRuleThreadsKey));
+
+  settings.snippetBudget
+    = base::TimeDelta::FromMilliseconds(
+        std::max(0, configuration.value<int>(kSnippetBudgetKey)));
+
+  settings.translationUnitBudget
+    = base::TimeDelta::FromMilliseconds(
+        std::max(0, configuration.value<int>(kTranslationUnitBudgetKey)));
+
+  settings.abortOverBudget
+    = configuration.value<bool>(kAbortOverBudgetKey);
+
+  const std::string slowSnippetLog
+    = configuration.value(kSlowSnippetLogKey);
+  if(!slowSnippetLog.empty()) {
+    settings.slowSnippetLog = base::FilePath{slowSnippetLog};
+  }
+
+  settings.slowSnippetThreshold
+    = base::TimeDelta::FromMilliseconds(
+        std::max(0, configuration.value<int>(kSlowSnippetThresholdKey)));
+
+  return settings;
+}
+
+} // namespace plugin
@@ -0,0 +1,354 @@
+#include <flex_reflect_plugin/SnippetValidator.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/AnnotationMethods.hpp>
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp>
+#include <flex_reflect_plugin/GeneratedFileWriter.hpp>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/Attr.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Frontend/ASTUnit.h>
+#include <clang/Frontend/TextDiagnosticPrinter.h>
+#include <clang/Tooling/Tooling.h>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <base/logging.h>
+#include <base/stl_util.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/strings/string_piece.h>
+#include <base/strings/string_util.h>
+#include <base/threading/simple_thread.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+#include <memory>
+
+namespace plugin {
+
+namespace {
+
+static const char kSnippetFileName[] = "flex_reflect_snippet.cc";
+
+// names of variables must match `ReflectTooling::executeCodeAndReplace`
+static const char kCodeAndReplacePrologue[] =
+  "void flex_reflect_validate_snippet() {"
+  "[](){"
+  "const clang::ast_matchers::MatchFinder::MatchResult&"
+  " clangMatchResult"
+  " = *(const clang::ast_matchers::MatchFinder::MatchResult*)nullptr;"
+  "clang::Rewriter& clangRewriter = *(clang::Rewriter*)nullptr;"
+  "const clang::Decl* clangDecl = (const clang::Decl*)nullptr;"
+  "return\n";
+
+static const char kCodeAndReplaceEpilogue[] = "\n;}();}\n";
+
+static const char kToolName[] = "flex_reflect_snippet_validator";
+
+struct Snippet {
+  const clang::AnnotateAttr* annotateAttr = nullptr;
+
+  // expansion location of annotation, orders snippets
+  // like interpreter executes them
+  clang::SourceLocation loc;
+
+  // human readable location of annotation
+  std::string location;
+
+  // code stored in annotation
+  std::string code;
+
+  // variants of code to check, snippet is valid
+  // if at least one of them compiles
+  std::vector<std::string> variants;
+
+  // `executeCode` declares variables, functions and includes headers
+  // visible to later snippets, first variant is declared
+  // at file scope and kept if it compiles
+  bool changesInterpreterState = false;
+
+  // code of earlier valid snippets that changed interpreter state
+  std::string interpreterState;
+
+  // diagnostics of variants that did not compile
+  std::string diagnostics;
+
+  // index of compiled variant
+  int validVariant = -1;
+};
+
+// `#line` directive maps diagnostics to location of annotation
+static std::string LineDirective(
+  const clang::PresumedLoc& presumedLoc)
+{
+  if(presumedLoc.isInvalid()) {
+    return std::string{};
+  }
+  return "\n#line "
+    + base::NumberToString(presumedLoc.getLine())
+    + " \"" + presumedLoc.getFilename() + "\"\n";
+}
+
+class SnippetCollector
+  : public clang::RecursiveASTVisitor<SnippetCollector> {
+public:
+  SnippetCollector(
+    const clang::SourceManager& sourceManager
+    , TranslationUnitFileFilter& fileFilter
+    , std::vector<std::unique_ptr<Snippet>>& snippets)
+    : sourceManager_(sourceManager)
+    , fileFilter_(fileFilter)
+    , snippets_(snippets)
+  {}
+
+  // skips declarations of files without annotations
+  bool TraverseDecl(clang::Decl* decl)
+  {
+    if(!fileFilter_.ShouldTraverse(decl)) {
+      return true;
+    }
+    return RecursiveASTVisitor::TraverseDecl(decl);
+  }
+
+  bool VisitDecl(clang::Decl* decl)
+  {
+    for(const clang::AnnotateAttr* annotateAttr
+          : decl->specific_attrs<clang::AnnotateAttr>())
+    {
+      addSnippet(annotateAttr);
+    }
+    return true;
+  }
+
+private:
+  void addSnippet(const clang::AnnotateAttr* annotateAttr)
+  {
+    base::StringPiece annotation(
+      annotateAttr->getAnnotation().data()
+      , annotateAttr->getAnnotation().size());
+    if(!annotation.starts_with(kGenPrefix)) {
+      return;
+    }
+    annotation.remove_prefix(base::size(kGenPrefix) - 1);
+
+    const clang::PresumedLoc presumedLoc
+      = sourceManager_.getPresumedLoc(
+          sourceManager_.getExpansionLoc(annotateAttr->getLocation()));
+    const std::string lineDirective = LineDirective(presumedLoc);
+
+    auto snippet = std::make_unique<Snippet>();
+    if(annotation.starts_with(kExecuteCodeAndReplaceMethod)
+       || annotation.starts_with(kExecuteCodeAndEditMethod))
+    {
+      // both methods return value of code
+      annotation.remove_prefix(
+        annotation.starts_with(kExecuteCodeAndReplaceMethod)
+        ? base::size(kExecuteCodeAndReplaceMethod) - 1
+        : base::size(kExecuteCodeAndEditMethod) - 1);
+      snippet->variants.push_back(
+        kCodeAndReplacePrologue
+        + lineDirective
+        + annotation.as_string()
+        + kCodeAndReplaceEpilogue);
+    } else if(annotation.starts_with(kExecuteCodeMethod)) {
+      annotation.remove_prefix(base::size(kExecuteCodeMethod) - 1);
+      // interpreter accepts both declarations and statements,
+      // declarations stay visible to later snippets
+      snippet->variants.push_back(
+        lineDirective
+        + annotation.as_string()
+        + "\n");
+      snippet->variants.push_back(
+        "void flex_reflect_validate_snippet() {"
+        + lineDirective
+        + annotation.as_string()
+        + "\n;}\n");
+      snippet->changesInterpreterState = true;
+    } else {
+      return;
+    }
+
+    snippet->annotateAttr = annotateAttr;
+    snippet->loc
+      = sourceManager_.getExpansionLoc(annotateAttr->getLocation());
+    snippet->code = annotation.as_string();
+    if(presumedLoc.isValid()) {
+      snippet->location = std::string(presumedLoc.getFilename())
+        + ":" + base::NumberToString(presumedLoc.getLine())
+        + ":" + base::NumberToString(presumedLoc.getColumn());
+    }
+    snippets_.push_back(std::move(snippet));
+  }
+
+private:
+  const clang::SourceManager& sourceManager_;
+
+  TranslationUnitFileFilter& fileFilter_;
+
+  std::vector<std::unique_ptr<Snippet>>& snippets_;
+};
+
+// parses variants of |snippet| after its |interpreterState|,
+// diagnostics are collected per snippet
+// (checks on worker threads must not share stderr)
+static void CheckSnippet(
+  Snippet& snippet
+  , const std::vector<std::string>& compilerArgs)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::SnippetValidator::CheckSnippet");
+
+  for(size_t i = 0; i < snippet.variants.size(); i++) {
+    std::string diagnostics;
+    llvm::raw_string_ostream diagnosticsStream(diagnostics);
+    clang::TextDiagnosticPrinter diagnosticPrinter(
+      diagnosticsStream, new clang::DiagnosticOptions());
+    std::unique_ptr<clang::ASTUnit> astUnit
+      = clang::tooling::buildASTFromCodeWithArgs(
+          snippet.interpreterState + snippet.variants[i]
+          , compilerArgs
+          , kSnippetFileName
+          , kToolName
+          , std::make_shared<clang::PCHContainerOperations>()
+          , clang::tooling::getClangStripDependencyFileAdjuster()
+          , clang::tooling::FileContentMappings()
+          , &diagnosticPrinter);
+    if(astUnit && !astUnit->getDiagnostics().hasErrorOccurred()) {
+      snippet.validVariant = static_cast<int>(i);
+      return;
+    }
+    snippet.diagnostics += diagnosticsStream.str();
+  }
+}
+
+class SnippetCheck
+  : public base::DelegateSimpleThread::Delegate {
+public:
+  SnippetCheck(
+    Snippet& snippet
+    , const std::vector<std::string>& compilerArgs)
+    : snippet_(snippet)
+    , compilerArgs_(compilerArgs)
+  {}
+
+  void Run() override
+  {
+    CheckSnippet(snippet_, compilerArgs_);
+  }
+
+private:
+  Snippet& snippet_;
+
+  const std::vector<std::string>& compilerArgs_;
+
+  DISALLOW_COPY_AND_ASSIGN(SnippetCheck);
+};
+
+} // namespace
+
+SnippetValidator::SnippetValidator(
+  const std::vector<std::string>& compilerArgs
+  , int numThreads)
+  : compilerArgs_(compilerArgs)
+  , numThreads_(numThreads)
+{
+  DCHECK_GT(numThreads_, 0);
+
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+SnippetValidator::~SnippetValidator()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+}
+
+std::set<const clang::AnnotateAttr*>
+  SnippetValidator::ValidateTranslationUnit(
+    clang::ASTContext& context
+    , AnnotationPrescanner* prescanner)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::SnippetValidator::ValidateTranslationUnit");
+
+  std::vector<std::unique_ptr<Snippet>> snippets;
+  {
+    TranslationUnitFileFilter fileFilter(
+      prescanner, context.getSourceManager());
+    SnippetCollector collector(
+      context.getSourceManager(), fileFilter, snippets);
+    collector.TraverseDecl(context.getTranslationUnitDecl());
+  }
+
+  std::set<const clang::AnnotateAttr*> invalidSnippets;
+  if(snippets.empty()) {
+    return invalidSnippets;
+  }
+
+  // order in which interpreter executes snippets
+  const clang::SourceManager& sourceManager = context.getSourceManager();
+  std::stable_sort(
+    snippets.begin(), snippets.end()
+    , [&sourceManager](
+        const std::unique_ptr<Snippet>& lhs
+        , const std::unique_ptr<Snippet>& rhs)
+      {
+        return sourceManager.isBeforeInTranslationUnit(lhs->loc, rhs->loc);
+      });
+
+  /// \note snippets are validated as one growing translation unit:
+  /// `executeCode` snippets are checked one after another on this thread,
+  /// code of valid ones is visible to all later snippets,
+  /// other snippets do not change interpreter state
+  /// and are checked concurrently by |pool|
+  std::vector<std::unique_ptr<SnippetCheck>> checks;
+  checks.reserve(snippets.size());
+  {
+    base::DelegateSimpleThreadPool pool(
+      "FlexReflectSnippetValidator"
+      , std::min(numThreads_, static_cast<int>(snippets.size())));
+    pool.Start();
+    std::string interpreterState;
+    for(std::unique_ptr<Snippet>& snippet : snippets) {
+      snippet->interpreterState = interpreterState;
+      if(!snippet->changesInterpreterState) {
+        checks.push_back(
+          std::make_unique<SnippetCheck>(*snippet, compilerArgs_));
+        pool.AddWork(checks.back().get());
+        continue;
+      }
+      CheckSnippet(*snippet, compilerArgs_);
+      // statements are checked inside of function
+      // and declare nothing
+      if(snippet->validVariant == 0) {
+        interpreterState += snippet->variants.front();
+      }
+    }
+    pool.JoinAll();
+  }
+
+  for(const std::unique_ptr<Snippet>& snippet : snippets) {
+    if(snippet->validVariant >= 0) {
+      continue;
+    }
+    LOG(ERROR)
+      << "invalid interpreted code at "
+      << snippet->location
+      << " (snippet hash "
+      << ContentHash(snippet->code)
+      << "):\n"
+      << snippet->diagnostics;
+    invalidSnippets.insert(snippet->annotateAttr);
+  }
+
+  VLOG(1)
+    << "validated interpreted code of "
+    << snippets.size()
+    << " annotations, invalid: "
+    << invalidSnippets.size();
+
+  return invalidSnippets;
+}
+
+} // namespace plugin
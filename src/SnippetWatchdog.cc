@@ -0,0 +1,251 @@
+#include <flex_reflect_plugin/SnippetWatchdog.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/Settings.hpp>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/threading/watchdog.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+
+namespace plugin {
+
+namespace {
+
+static const char kWatchdogThreadName[] = "FlexReflectSnippetWatchdog";
+
+static const char kStatusSlow[] = "slow";
+
+static const char kStatusOverBudget[] = "over_budget";
+
+static const char kStatusAborted[] = "aborted";
+
+} // namespace
+
+class SnippetWatchdog::BudgetAlarm
+  : public base::Watchdog {
+public:
+  BudgetAlarm(
+    base::TimeDelta duration
+    , SnippetWatchdog* owner)
+    : base::Watchdog(duration, kWatchdogThreadName, true)
+    , owner_(owner)
+  {}
+
+  void Alarm() override
+  {
+    owner_->onAlarm();
+  }
+
+private:
+  SnippetWatchdog* owner_;
+
+  DISALLOW_COPY_AND_ASSIGN(BudgetAlarm);
+};
+
+SnippetWatchdog::ScopedSnippet::ScopedSnippet(
+  SnippetWatchdog* watchdog
+  , const std::string& location
+  , const std::string& snippetHash)
+  : watchdog_(watchdog)
+  , startTime_(base::TimeTicks::Now())
+{
+  if(watchdog_) {
+    watchdog_->snippetStarted(location, snippetHash);
+  }
+}
+
+SnippetWatchdog::ScopedSnippet::~ScopedSnippet()
+{
+  if(watchdog_) {
+    watchdog_->snippetFinished(base::TimeTicks::Now() - startTime_);
+  }
+}
+
+bool SnippetWatchdog::ScopedSnippet::IsOverBudget() const
+{
+  return watchdog_ && watchdog_->isOverBudget();
+}
+
+SnippetWatchdog::SnippetWatchdog(
+  const FlexReflectSettings& settings)
+  : snippetBudget_(settings.snippetBudget)
+  , translationUnitBudget_(settings.translationUnitBudget)
+  , slowSnippetThreshold_(settings.slowSnippetThreshold)
+  , abortOverBudget_(settings.abortOverBudget)
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+
+  // single watchdog serves both budgets,
+  // it is armed "some time ago" if remaining budget is smaller
+  const base::TimeDelta alarmDuration
+    = !snippetBudget_.is_zero()
+      ? snippetBudget_
+      : translationUnitBudget_;
+  if(!alarmDuration.is_zero()) {
+    alarm_ = std::make_unique<BudgetAlarm>(alarmDuration, this);
+  }
+
+  if(!settings.slowSnippetLog.empty()) {
+    base::AutoLock lock(lock_);
+    slowSnippetLog_.Initialize(
+      settings.slowSnippetLog
+      , base::File::FLAG_OPEN_ALWAYS | base::File::FLAG_APPEND);
+    LOG_IF(ERROR, !slowSnippetLog_.IsValid())
+      << "unable to open slow snippet log: "
+      << settings.slowSnippetLog
+      << " error: "
+      << base::File::ErrorToString(slowSnippetLog_.error_details());
+  }
+}
+
+SnippetWatchdog::~SnippetWatchdog()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(alarm_) {
+    alarm_->Cleanup();
+  }
+}
+
+// static
+bool SnippetWatchdog::IsRequired(
+  const FlexReflectSettings& settings)
+{
+  return !settings.snippetBudget.is_zero()
+    || !settings.translationUnitBudget.is_zero()
+    || !settings.slowSnippetLog.empty();
+}
+
+void SnippetWatchdog::ResetTranslationUnit()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  translationUnitTime_ = base::TimeDelta();
+}
+
+bool SnippetWatchdog::HasTranslationUnitBudget() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  return translationUnitBudget_.is_zero()
+    || translationUnitTime_ < translationUnitBudget_;
+}
+
+void SnippetWatchdog::snippetStarted(
+  const std::string& location
+  , const std::string& snippetHash)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  {
+    base::AutoLock lock(lock_);
+    location_ = location;
+    snippetHash_ = snippetHash;
+    snippetStartTime_ = base::TimeTicks::Now();
+    isOverBudget_ = false;
+  }
+
+  if(!alarm_) {
+    return;
+  }
+
+  base::TimeDelta limit = base::TimeDelta::Max();
+  if(!snippetBudget_.is_zero()) {
+    limit = snippetBudget_;
+  }
+  if(!translationUnitBudget_.is_zero()) {
+    limit = std::min(limit, translationUnitBudget_ - translationUnitTime_);
+  }
+  const base::TimeDelta alarmDuration
+    = !snippetBudget_.is_zero()
+      ? snippetBudget_
+      : translationUnitBudget_;
+  alarm_->ArmSomeTimeDeltaAgo(
+    std::max(base::TimeDelta(), alarmDuration - limit));
+}
+
+void SnippetWatchdog::snippetFinished(
+  base::TimeDelta elapsed)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(alarm_) {
+    alarm_->Disarm();
+  }
+
+  const bool hadTranslationUnitBudget = HasTranslationUnitBudget();
+  translationUnitTime_ += elapsed;
+
+  {
+    base::AutoLock lock(lock_);
+    if(isOverBudget_) {
+      writeSlowSnippet(elapsed, kStatusOverBudget);
+    } else if(elapsed >= slowSnippetThreshold_) {
+      writeSlowSnippet(elapsed, kStatusSlow);
+    }
+  }
+
+  LOG_IF(ERROR, hadTranslationUnitBudget && !HasTranslationUnitBudget())
+    << "interpreted code used time budget of translation unit ("
+    << translationUnitBudget_.InMilliseconds()
+    << " ms), remaining interpreted code of translation unit is skipped";
+}
+
+bool SnippetWatchdog::isOverBudget() const
+{
+  base::AutoLock lock(lock_);
+  return isOverBudget_;
+}
+
+void SnippetWatchdog::onAlarm()
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::SnippetWatchdog::onAlarm");
+
+  base::AutoLock lock(lock_);
+  isOverBudget_ = true;
+
+  LOG(ERROR)
+    << "interpreted code at "
+    << location_
+    << " (snippet hash "
+    << snippetHash_
+    << ") exceeded its time budget";
+
+  if(abortOverBudget_) {
+    writeSlowSnippet(
+      base::TimeTicks::Now() - snippetStartTime_, kStatusAborted);
+    LOG(FATAL)
+      << "aborted over budget interpreted code at "
+      << location_;
+  }
+}
+
+void SnippetWatchdog::writeSlowSnippet(
+  base::TimeDelta elapsed
+  , const std::string& status)
+{
+  lock_.AssertAcquired();
+
+  if(!slowSnippetLog_.IsValid()) {
+    return;
+  }
+
+  // tab separated: milliseconds, location, snippet hash, status
+  const std::string line
+    = base::NumberToString(elapsed.InMilliseconds())
+    + "\t" + location_
+    + "\t" + snippetHash_
+    + "\t" + status
+    + "\n";
+  if(slowSnippetLog_.WriteAtCurrentPos(line.data(), line.size())
+     != static_cast<int>(line.size()))
+  {
+    LOG(ERROR)
+      << "unable to write slow snippet log";
+  }
+}
+
+} // namespace plugin
@@ -0,0 +1,233 @@
+#include <flex_reflect_plugin/StreamingReplacementSink.hpp> // IWYU pragma: associated
+
+#include <flexlib/clangUtils.hpp>
+
+#include <clang/AST/Decl.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/files/file_util.h>
+#include <base/trace_event/trace_event.h>
+
+#include <algorithm>
+#include <limits>
+#include <string>
+
+namespace plugin {
+
+namespace {
+
+// `#include "..."` has no escape sequences,
+// so quote and line breaks can not be spelled in it
+static bool CanBeIncluded(
+  const std::string& headerName)
+{
+  return !headerName.empty()
+    && headerName.find_first_of("\"\r\n") == std::string::npos;
+}
+
+} // namespace
+
+StreamingReplacementSink::StreamingReplacementSink(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , const Options& options)
+  : rewriter_(rewriter)
+  , nodeDecl_(nodeDecl)
+  , options_(options)
+  , spillFileWriter_("spill files")
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+
+  DCHECK(nodeDecl_);
+  DCHECK(!options_.spillThreshold || !options_.spillFile.empty())
+    << "spill file required by spill threshold";
+
+  startLoc_ = nodeDecl_->getBeginLoc();
+  endLoc_ = nodeDecl_->getEndLoc();
+  clang_utils::expandLocations(startLoc_, endLoc_, rewriter_);
+}
+
+StreamingReplacementSink::~StreamingReplacementSink()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  DCHECK(isFinished_ || !report_.chunks)
+    << "StreamingReplacementSink::Finish() must be called";
+
+  if(spillFile_.IsValid()) {
+    spillFile_.Close();
+    base::DeleteFile(tempSpillFile_);
+  }
+}
+
+bool StreamingReplacementSink::Append(
+  base::StringPiece chunk)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  DCHECK(!isFinished_);
+
+  if(report_.isFailed) {
+    return false;
+  }
+
+  if(chunk.empty()) {
+    return true;
+  }
+
+  const bool needSpill
+    = spillFile_.IsValid()
+      || (options_.spillThreshold
+          && report_.bufferBytes + chunk.size() > options_.spillThreshold);
+  // first chunk always goes to rewrite buffer,
+  // so declaration is replaced even if whole output is spilled
+  if(needSpill && report_.chunks) {
+    if(!appendToSpillFile(chunk)) {
+      LOG(ERROR)
+        << "dropped streamed replacement chunk of "
+        << chunk.size()
+        << " bytes, output of rule is incomplete";
+      report_.isFailed = true;
+      return false;
+    }
+    return true;
+  }
+
+  const llvm::StringRef text(chunk.data(), chunk.size());
+  if(!report_.chunks) {
+    /// \note text inserted around declaration by other rules
+    /// is kept and must not be counted as part of replaced range
+    clang::Rewriter::RewriteOptions rangeOptions;
+    rangeOptions.IncludeInsertsAtBeginOfRange = false;
+    rangeOptions.IncludeInsertsAtEndOfRange = false;
+    rewriter_.ReplaceText(
+      startLoc_
+      , rewriter_.getRangeSize(
+          clang::SourceRange(startLoc_, endLoc_), rangeOptions)
+      , text);
+  } else {
+    /// \note rewrite buffer maps end of replaced range
+    /// after previously inserted text, so chunks keep their order
+    rewriter_.InsertTextAfterToken(endLoc_, text);
+  }
+  report_.chunks++;
+  report_.bufferBytes += chunk.size();
+  return true;
+}
+
+bool StreamingReplacementSink::appendToSpillFile(
+  base::StringPiece chunk)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!spillFile_.IsValid()) {
+    if(!CanBeIncluded(includeName())) {
+      LOG(ERROR)
+        << "spill file can not be spelled in #include: "
+        << includeName();
+      return false;
+    }
+    // same directory, so temporary file can be renamed into spill file
+    const base::FilePath spillDir = options_.spillFile.DirName();
+    if(!base::CreateDirectory(spillDir)
+       || !base::CreateTemporaryFileInDir(spillDir, &tempSpillFile_))
+    {
+      LOG(ERROR)
+        << "unable to create temporary spill file in: "
+        << spillDir;
+      return false;
+    }
+    spillFile_.Initialize(
+      tempSpillFile_
+      , base::File::FLAG_OPEN_TRUNCATED | base::File::FLAG_WRITE);
+    if(!spillFile_.IsValid()) {
+      LOG(ERROR)
+        << "unable to open temporary spill file: "
+        << tempSpillFile_
+        << " error: "
+        << base::File::ErrorToString(spillFile_.error_details());
+      base::DeleteFile(tempSpillFile_);
+      return false;
+    }
+  }
+
+  const size_t chunkSize = chunk.size();
+  // `base::File` writes at most `int` bytes at once
+  while(!chunk.empty()) {
+    const int sliceSize = static_cast<int>(
+      std::min<size_t>(chunk.size(), std::numeric_limits<int>::max()));
+    const int written
+      = spillFile_.WriteAtCurrentPos(chunk.data(), sliceSize);
+    if(written <= 0) {
+      LOG(ERROR)
+        << "unable to write spill file: "
+        << options_.spillFile;
+      return false;
+    }
+    chunk.remove_prefix(static_cast<size_t>(written));
+  }
+  report_.chunks++;
+  report_.spilledBytes += chunkSize;
+  return true;
+}
+
+std::string StreamingReplacementSink::includeName() const
+{
+  return options_.includeName.empty()
+    ? options_.spillFile.value()
+    : options_.includeName;
+}
+
+const StreamingReplacementSink::Report&
+  StreamingReplacementSink::Finish()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  DCHECK(!isFinished_);
+  TRACE_EVENT2("toplevel",
+               "plugin::StreamingReplacementSink::Finish",
+               "buffer_bytes", report_.bufferBytes,
+               "spilled_bytes", report_.spilledBytes);
+
+  isFinished_ = true;
+
+  if(report_.isFailed) {
+    LOG(ERROR)
+      << "streamed replacement failed, spill file is not written: "
+      << options_.spillFile;
+    if(spillFile_.IsValid()) {
+      spillFile_.Close();
+      base::DeleteFile(tempSpillFile_);
+    }
+    return report_;
+  }
+
+  if(spillFile_.IsValid()) {
+    spillFile_.Close();
+    const size_t writtenFiles = spillFileWriter_.writtenFiles();
+    if(spillFileWriter_.ReplaceIfChanged(
+         tempSpillFile_, options_.spillFile))
+    {
+      report_.spillFileChanged
+        = spillFileWriter_.writtenFiles() != writtenFiles;
+      rewriter_.InsertTextAfterToken(
+        endLoc_
+        , "\n#include \"" + includeName() + "\"\n");
+    } else {
+      report_.isFailed = true;
+    }
+  }
+
+  VLOG(9)
+    << "streamed replacement of "
+    << report_.chunks
+    << " chunks: "
+    << report_.bufferBytes
+    << " bytes into rewrite buffer, "
+    << report_.spilledBytes
+    << " bytes into spill file "
+    << options_.spillFile;
+
+  return report_;
+}
+
+} // namespace plugin
@@ -1,5 +1,14 @@
 #include <flex_reflect_plugin/Tooling.hpp> // IWYU pragma: associated
 
+#include <flex_reflect_plugin/AnnotationMethods.hpp>
+#include <flex_reflect_plugin/AnnotationPrescanner.hpp>
+#include <flex_reflect_plugin/EditApplier.hpp>
+#include <flex_reflect_plugin/HashEqRule.hpp>
+#include <flex_reflect_plugin/PooledRule.hpp>
+#include <flex_reflect_plugin/ReflectEdits.hpp>
+#include <flex_reflect_plugin/RuleChain.hpp>
+#include <flex_reflect_plugin/VisitorRule.hpp>
+
 #include <flexlib/ToolPlugin.hpp>
 #include <flexlib/core/errors/errors.hpp>
 #include <flexlib/utils.hpp>
@@ -15,6 +24,8 @@
 #include "flexlib/ClingInterpreterModule.hpp"
 #endif // CLING_IS_ON
 
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/DeclCXX.h>
 #include <clang/Rewrite/Core/Rewriter.h>
 #include <clang/ASTMatchers/ASTMatchFinder.h>
 
@@ -23,21 +34,269 @@
 #include <base/command_line.h>
 #include <base/debug/alias.h>
 #include <base/debug/stack_trace.h>
+#include <base/files/file_util.h>
 #include <base/memory/ptr_util.h>
 #include <base/sequenced_task_runner.h>
 #include <base/strings/string_util.h>
 #include <base/trace_event/trace_event.h>
+#include <base/trace_event/traced_value.h>
+#include <base/threading/simple_thread.h>
+
+#include <llvm/Support/raw_ostream.h>
+
+#include <algorithm>
+#include <iterator>
+#include <memory>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <dlfcn.h>
+#include <link.h>
 
 namespace plugin {
 
+namespace {
+
+static const char kDepfileExtension[] = ".d";
+
+// path to shared library of plugin,
+// generated files depend on rules provided by it
+static base::FilePath PluginModulePath()
+{
+  Dl_info info;
+  if(dladdr(reinterpret_cast<void*>(&PluginModulePath), &info)
+     && info.dli_fname)
+  {
+    return base::FilePath{info.dli_fname};
+  }
+  return base::FilePath{};
+}
+
+static int CollectModuleInDirectory(
+  struct dl_phdr_info* info
+  , size_t /*size*/
+  , void* data)
+{
+  std::pair<base::FilePath, std::set<base::FilePath>>* modules
+    = static_cast<std::pair<base::FilePath, std::set<base::FilePath>>*>(
+        data);
+  if(info->dlpi_name && info->dlpi_name[0] != '\0') {
+    const base::FilePath module{info->dlpi_name};
+    if(module.DirName() == modules->first) {
+      modules->second.insert(module);
+    }
+  }
+  // continue iteration
+  return 0;
+}
+
+// paths to shared libraries of all loaded plugins,
+// rules of other plugins may be called by `funccall`.
+/// \note flextool loads plugins from one directory,
+/// so plugin is any library loaded from directory of this plugin
+static std::set<base::FilePath> PluginModulePaths()
+{
+  const base::FilePath pluginPath = PluginModulePath();
+  if(pluginPath.empty()) {
+    return std::set<base::FilePath>{};
+  }
+  std::pair<base::FilePath, std::set<base::FilePath>> modules{
+    pluginPath.DirName(), std::set<base::FilePath>{pluginPath}};
+  dl_iterate_phdr(&CollectModuleInDirectory, &modules);
+  return modules.second;
+}
+
+using SourceTransformCallback
+  = ::clang_utils::SourceTransformRules::mapped_type;
+
+struct RuleCall {
+  const ::flexlib::parsed_func* func;
+
+  const SourceTransformCallback* callback;
+
+  // pure rule only reads AST and returns text,
+  // so it can run concurrently with other pure rules
+  bool isPure;
+};
+
+class RuleTask {
+public:
+  RuleTask(
+    const RuleCall& ruleCall
+    , const clang_utils::MatchResult& matchResult
+    , clang::Rewriter& rewriter
+    , const clang::Decl* nodeDecl
+    , const std::vector<::flexlib::parsed_func>& parsedFuncs)
+    : ruleCall_(ruleCall)
+    , matchResult_(matchResult)
+    , rewriter_(rewriter)
+    , nodeDecl_(nodeDecl)
+    , parsedFuncs_(parsedFuncs)
+  {}
+
+  void Run()
+  {
+    TRACE_EVENT1("toplevel",
+                 "plugin::FlexReflect::sourceTransformRule",
+                 "rule", ruleCall_.func->parsed_func_.func_name_);
+
+    result_ = ruleCall_.callback->Run(clang_utils::SourceTransformOptions{
+        *ruleCall_.func
+        , matchResult_
+        , rewriter_
+        , nodeDecl_
+        , parsedFuncs_
+      });
+  }
+
+  const clang_utils::SourceTransformResult& result() const
+  {
+    return result_;
+  }
+
+private:
+  const RuleCall& ruleCall_;
+
+  const clang_utils::MatchResult& matchResult_;
+
+  clang::Rewriter& rewriter_;
+
+  const clang::Decl* nodeDecl_;
+
+  const std::vector<::flexlib::parsed_func>& parsedFuncs_;
+
+  clang_utils::SourceTransformResult result_;
+
+  DISALLOW_COPY_AND_ASSIGN(RuleTask);
+};
+
+// fills lazily computed caches of `ASTContext`
+// (record layouts, sizes and alignments of types)
+// for annotated record, its bases and types of its fields,
+// so concurrently running pure rules only read them.
+/// \note `ASTContext` is not thread-safe, so pure rule
+/// must query only declarations reachable from annotated one
+static void PrecomputeASTQueries(
+  const clang::Decl* nodeDecl)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexReflect::PrecomputeASTQueries");
+
+  const clang::RecordDecl* record
+    = llvm::dyn_cast_or_null<clang::RecordDecl>(nodeDecl);
+  if(!record) {
+    return;
+  }
+
+  std::vector<const clang::RecordDecl*> pending{record};
+  std::set<const clang::RecordDecl*> visited;
+  while(!pending.empty()) {
+    const clang::RecordDecl* current = pending.back()->getDefinition();
+    pending.pop_back();
+    if(!current
+       || current->isInvalidDecl()
+       || current->isDependentType()
+       || !visited.insert(current).second)
+    {
+      continue;
+    }
+
+    clang::ASTContext& context = current->getASTContext();
+    const clang::QualType recordType = context.getRecordType(current);
+    context.getASTRecordLayout(current);
+    context.getTypeInfo(recordType);
+    context.hasUniqueObjectRepresentations(recordType);
+
+    if(const clang::CXXRecordDecl* cxxRecord
+         = llvm::dyn_cast<clang::CXXRecordDecl>(current))
+    {
+      for(const clang::CXXBaseSpecifier& base : cxxRecord->bases()) {
+        if(const clang::RecordDecl* baseRecord
+             = base.getType()->getAsRecordDecl())
+        {
+          pending.push_back(baseRecord);
+        }
+      }
+    }
+
+    for(const clang::FieldDecl* field : current->fields()) {
+      const clang::QualType fieldType = field->getType();
+      if(fieldType->isDependentType() || fieldType->isIncompleteType()) {
+        continue;
+      }
+      context.getTypeInfo(fieldType);
+      context.hasUniqueObjectRepresentations(fieldType);
+      if(const clang::RecordDecl* fieldRecord
+           = context.getBaseElementType(fieldType)->getAsRecordDecl())
+      {
+        pending.push_back(fieldRecord);
+      }
+    }
+  }
+}
+
+// human readable location of annotated declaration
+static std::string AnnotationLocation(
+  const clang_utils::MatchResult& matchResult
+  , const clang::Decl* nodeDecl)
+{
+  DCHECK(matchResult.SourceManager);
+  const clang::PresumedLoc presumedLoc
+    = matchResult.SourceManager->getPresumedLoc(
+        matchResult.SourceManager->getExpansionLoc(nodeDecl->getBeginLoc()));
+  if(presumedLoc.isInvalid()) {
+    return std::string{};
+  }
+  return std::string(presumedLoc.getFilename())
+    + ":" + std::to_string(presumedLoc.getLine())
+    + ":" + std::to_string(presumedLoc.getColumn());
+}
+
+// arguments of trace event, created only if tracing is enabled
+static std::unique_ptr<base::trace_event::TracedValue>
+  AnnotationTraceValue(
+    const clang_utils::MatchResult& matchResult
+    , const clang::Decl* nodeDecl
+    , base::StringPiece method
+    , base::StringPiece code)
+{
+  auto value = std::make_unique<base::trace_event::TracedValue>();
+
+  DCHECK(matchResult.SourceManager);
+  const clang::PresumedLoc presumedLoc
+    = matchResult.SourceManager->getPresumedLoc(
+        matchResult.SourceManager->getExpansionLoc(nodeDecl->getBeginLoc()));
+  if(presumedLoc.isValid()) {
+    value->SetString("file", presumedLoc.getFilename());
+    value->SetInteger("line", presumedLoc.getLine());
+  }
+
+  value->SetString("method", method);
+  value->SetString("snippet_hash", ContentHash(code));
+  return value;
+}
+
+} // namespace
+
 ReflectTooling::ReflectTooling(
   const ::plugin::ToolPlugin::Events::RegisterAnnotationMethods& event
+  , const FlexReflectSettings& settings
+#if defined(CLING_IS_ON)
+  , ClingInterpreterProvider clingInterpreterProvider
+#endif // CLING_IS_ON
+) :
 #if defined(CLING_IS_ON)
-  , ::cling_utils::ClingInterpreter* clingInterpreter
+  clingInterpreterProvider_(std::move(clingInterpreterProvider)),
 #endif // CLING_IS_ON
-) : clingInterpreter_(clingInterpreter)
+  settings_(settings),
+  generatedFileWriter_("generated files"),
+  depfileWriter_("depfiles")
 {
-  DCHECK(clingInterpreter_);
+#if defined(CLING_IS_ON)
+  DCHECK(clingInterpreterProvider_);
+#endif // CLING_IS_ON
 
   DCHECK(event.sourceTransformPipeline);
   ::clang_utils::SourceTransformPipeline& sourceTransformPipeline
@@ -46,12 +305,514 @@ ReflectTooling::ReflectTooling(
   sourceTransformRules_
     = &sourceTransformPipeline.sourceTransformRules;
 
+  // rules provided by plugin itself
+  {
+    (*sourceTransformRules_)[kMakeHashEqRule]
+      = base::BindRepeating(&MakeHashEq);
+    (*sourceTransformRules_)[kMakePooledRule]
+      = base::BindRepeating(&MakePooled);
+    (*sourceTransformRules_)[kMakeVisitorRule]
+      = base::BindRepeating(&MakeVisitor);
+
+    // rules of plugin edit source using rewriter,
+    // so they can not run concurrently
+    for(const char* rule
+          : {kMakeHashEqRule, kMakePooledRule, kMakeVisitorRule})
+    {
+      if(settings_.pureRules.erase(rule)) {
+        LOG(WARNING)
+          << rule
+          << " uses rewriter and can not be used as pure rule";
+      }
+    }
+  }
+
+  // threads are created once and reused by all annotations
+  if(settings_.ruleThreads > 1 && !settings_.pureRules.empty()) {
+    pureRulePool_ = std::make_unique<base::DelegateSimpleThreadPool>(
+      "FlexReflectPureRules"
+      , settings_.ruleThreads);
+    pureRulePool_->Start();
+  }
+
+  if(!settings_.outputDir.empty()) {
+    base::FilePath sourceRoot = settings_.sourceRoot;
+    if(sourceRoot.empty()) {
+      base::GetCurrentDirectory(&sourceRoot);
+    }
+    sourceRoot_ = base::MakeAbsoluteFilePath(sourceRoot);
+    LOG_IF(WARNING, sourceRoot_.empty())
+      << "unable to resolve source root: "
+      << sourceRoot;
+  }
+
+  if(!settings_.headerCacheDir.empty() && !settings_.outputDir.empty()) {
+    headerRewriteCache_ = std::make_unique<HeaderRewriteCache>(
+      settings_.headerCacheDir);
+  }
+
+  if(settings_.prescanAnnotations) {
+    annotationPrescanner_ = std::make_unique<AnnotationPrescanner>(
+      std::vector<std::string>(
+        std::begin(kAnnotationMethods), std::end(kAnnotationMethods)));
+  }
+
+#if defined(CLING_IS_ON)
+  if(SnippetWatchdog::IsRequired(settings_)) {
+    snippetWatchdog_ = std::make_unique<SnippetWatchdog>(settings_);
+  }
+
+  if(settings_.prevalidateSnippets) {
+    snippetValidator_ = std::make_unique<SnippetValidator>(
+      settings_.prevalidationArgs
+      , settings_.prevalidationThreads);
+  }
+#endif // CLING_IS_ON
+
   DETACH_FROM_SEQUENCE(sequence_checker_);
 }
 
 ReflectTooling::~ReflectTooling()
 {
   DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(rewriter_) {
+    LOG(WARNING)
+      << "translation unit was not finished, rewritten files are lost: "
+      << mainFile_;
+    rewriter_ = nullptr;
+    // outputs of headers are unknown
+    headerCacheKeys_.clear();
+  }
+  finishOutputs();
+
+  if(pureRulePool_) {
+    pureRulePool_->JoinAll();
+  }
+}
+
+#if defined(CLING_IS_ON)
+::cling_utils::ClingInterpreter* ReflectTooling::clingInterpreter()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!clingInterpreter_) {
+    TRACE_EVENT0("toplevel",
+                 "plugin::FlexReflect::clingInterpreter");
+    clingInterpreter_ = clingInterpreterProvider_.Run();
+    VLOG(9)
+      << "resolved Cling interpreter on first use";
+  }
+  return clingInterpreter_;
+}
+#endif // CLING_IS_ON
+
+void ReflectTooling::enterTranslationUnit(
+  const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  const clang::SourceManager* sourceManager = matchResult.SourceManager;
+  DCHECK(sourceManager);
+
+  base::FilePath mainFile;
+  if(const clang::FileEntry* fileEntry
+       = sourceManager->getFileEntryForID(sourceManager->getMainFileID()))
+  {
+    mainFile = base::FilePath{fileEntry->getName().str()};
+  }
+
+  if(sourceManager == sourceManager_ && mainFile == mainFile_) {
+    DCHECK_EQ(rewriter_, &rewriter);
+    return;
+  }
+
+  // AST of previous translation unit was never destroyed,
+  // so its rewriter can not be accessed safely
+  if(sourceManager_) {
+    LOG(WARNING)
+      << "translation unit was not finished, rewritten files are lost: "
+      << mainFile_;
+    rewriter_ = nullptr;
+    // outputs of headers are unknown
+    headerCacheKeys_.clear();
+    finishOutputs();
+  }
+
+  sourceManager_ = sourceManager;
+  mainFile_ = mainFile;
+  rewriter_ = &rewriter;
+
+  /// \note rewriter is owned by frontend action
+  /// and outlives AST of translation unit
+  /// (`FrontendAction::EndSourceFile` destroys `ASTContext` first),
+  /// so rewritten files are written once when all annotations processed
+  DCHECK(matchResult.Context);
+  matchResult.Context->AddDeallocation(
+    &ReflectTooling::finishTranslationUnitCallback
+    , this);
+
+  if(settings_.emitDepfiles) {
+    dependencyTracker_.ResetTranslationUnit(*sourceManager);
+    // all plugins are loaded before first translation unit
+    for(const base::FilePath& module : PluginModulePaths()) {
+      dependencyTracker_.AddCommonDependency(module);
+    }
+  }
+
+  if(snippetWatchdog_) {
+    snippetWatchdog_->ResetTranslationUnit();
+  }
+
+  prevalidateSnippets(matchResult);
+
+  prepareHeaderCache(matchResult);
+}
+
+// static
+void ReflectTooling::finishTranslationUnitCallback(
+  void* tooling)
+{
+  DCHECK(tooling);
+  static_cast<ReflectTooling*>(tooling)->finishTranslationUnit();
+}
+
+void ReflectTooling::finishTranslationUnit()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexReflect::finishTranslationUnit");
+
+  if(rewriter_) {
+    writeRewrittenFiles(*rewriter_);
+  }
+
+  rewriter_ = nullptr;
+  sourceManager_ = nullptr;
+  mainFile_.clear();
+
+  finishOutputs();
+}
+
+std::string ReflectTooling::ruleSetDescription() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  DCHECK(sourceTransformRules_);
+  std::vector<std::string> ruleNames;
+  ruleNames.reserve(sourceTransformRules_->size());
+  for(const auto& rule : (*sourceTransformRules_)) {
+    ruleNames.push_back(rule.first);
+  }
+  std::sort(ruleNames.begin(), ruleNames.end());
+  return base::JoinString(ruleNames, ";");
+}
+
+void ReflectTooling::prepareHeaderCache(
+  const clang_utils::MatchResult& matchResult)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexReflect::prepareHeaderCache");
+
+  cachedHeaders_.clear();
+  headerCacheKeys_.clear();
+
+  if(!headerRewriteCache_) {
+    return;
+  }
+
+  DCHECK(matchResult.Context);
+  for(auto& it : headerRewriteCache_->ComputeHeaderKeys(
+                   *matchResult.Context
+                   , ruleSetDescription()
+                   , annotationPrescanner_.get()))
+  {
+    base::Optional<std::string> contents;
+    if(!headerRewriteCache_->Lookup(it.second.key, &contents)) {
+      headerCacheKeys_[it.first] = it.second.key;
+      continue;
+    }
+
+    VLOG(9)
+      << "restored rewritten header from cache: "
+      << it.first;
+    cachedHeaders_.insert(it.first);
+    if(settings_.emitDepfiles) {
+      dependencyTracker_.AddDependencies(it.first, it.second.dependencies);
+    }
+    if(contents) {
+      writeGeneratedFile(it.first, *contents);
+    }
+  }
+}
+
+std::unique_ptr<ScopedHeaderCacheCheck> ReflectTooling::checkHeaderCache(
+  const clang_utils::MatchResult& matchResult
+  , const clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(headerCacheKeys_.empty()) {
+    return nullptr;
+  }
+
+  DCHECK(matchResult.SourceManager);
+  const clang::SourceManager& sourceManager = *matchResult.SourceManager;
+  return std::make_unique<ScopedHeaderCacheCheck>(
+    rewriter
+    , sourceManager.getFileID(
+        sourceManager.getExpansionLoc(nodeDecl->getBeginLoc()))
+    , base::BindRepeating(
+        &ReflectTooling::disableHeaderCache
+        , base::Unretained(this)));
+}
+
+void ReflectTooling::disableHeaderCache(
+  clang::FileID fileID)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  DCHECK(sourceManager_);
+  const base::FilePath header = FilePathOfLocation(
+    *sourceManager_, sourceManager_->getLocForStartOfFile(fileID));
+  if(headerCacheKeys_.erase(header)) {
+    VLOG(9)
+      << "annotation failed or edited header of other annotation,"
+         " header will not be cached: "
+      << header;
+  }
+}
+
+bool ReflectTooling::isInCachedHeader(
+  const clang_utils::MatchResult& matchResult
+  , const clang::Decl* nodeDecl) const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(cachedHeaders_.empty()) {
+    return false;
+  }
+
+  DCHECK(matchResult.SourceManager);
+  return cachedHeaders_.count(
+    FilePathOfLocation(*matchResult.SourceManager
+                       , nodeDecl->getBeginLoc())) > 0;
+}
+
+void ReflectTooling::prevalidateSnippets(
+  const clang_utils::MatchResult& matchResult)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexReflect::prevalidateSnippets");
+
+  invalidSnippets_.clear();
+
+  if(!snippetValidator_) {
+    return;
+  }
+
+  DCHECK(matchResult.Context);
+  invalidSnippets_
+    = snippetValidator_->ValidateTranslationUnit(
+        *matchResult.Context, annotationPrescanner_.get());
+
+  LOG_IF(ERROR, !invalidSnippets_.empty())
+    << "found "
+    << invalidSnippets_.size()
+    << " annotations with invalid interpreted code in "
+    << mainFile_
+    << ", interpreted code of that translation unit will not be executed";
+}
+
+bool ReflectTooling::canExecuteSnippets() const
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  /// \note partially executed code may produce broken output,
+  /// so translation unit with any invalid code is skipped entirely
+  if(!invalidSnippets_.empty()) {
+    return false;
+  }
+
+  return !snippetWatchdog_
+    || snippetWatchdog_->HasTranslationUnitBudget();
+}
+
+void ReflectTooling::replaceDeclText(
+  clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl
+  , base::StringPiece text)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT_WITH_FLOW1("toplevel",
+                         "plugin::FlexReflect::replaceDeclText",
+                         TRACE_ID_LOCAL(nodeDecl),
+                         TRACE_EVENT_FLAG_FLOW_IN,
+                         "bytes_rewritten", text.size());
+
+  clang::SourceLocation startLoc = nodeDecl->getBeginLoc();
+  // Note Stmt::getEndLoc() returns the source location prior to the
+  // token at the end of the line.  For instance, for:
+  // var = 123;
+  //      ^---- getEndLoc() points here.
+  clang::SourceLocation endLoc = nodeDecl->getEndLoc();
+
+  clang_utils::expandLocations(startLoc, endLoc, rewriter);
+
+  rewriter.ReplaceText(
+    clang::SourceRange(startLoc, endLoc)
+    , llvm::StringRef(text.data(), text.size()));
+}
+
+void ReflectTooling::recordDependencies(
+  const clang_utils::MatchResult& matchResult
+  , const clang::Decl* nodeDecl
+  , base::StringPiece interpretedCode)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!settings_.emitDepfiles) {
+    return;
+  }
+
+  DCHECK(matchResult.SourceManager);
+  const base::FilePath sourceFile
+    = FilePathOfLocation(*matchResult.SourceManager
+                         , nodeDecl->getBeginLoc());
+
+  dependencyTracker_.AddDeclDependencies(
+    sourceFile, *matchResult.SourceManager, nodeDecl);
+
+  if(!interpretedCode.empty()) {
+    dependencyTracker_.AddSnippetIncludes(sourceFile, interpretedCode);
+  }
+}
+
+void ReflectTooling::writeRewrittenFiles(
+  clang::Rewriter& rewriter)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT0("toplevel",
+               "plugin::FlexReflect::writeRewrittenFiles");
+
+  if(settings_.outputDir.empty()) {
+    return;
+  }
+
+  /// \note files are serialized one at a time,
+  /// so only rewrite buffers and single file are kept in memory
+  std::string contents;
+  clang::SourceManager& sourceManager = rewriter.getSourceMgr();
+  for(auto it = rewriter.buffer_begin(); it != rewriter.buffer_end(); ++it)
+  {
+    const clang::FileEntry* fileEntry
+      = sourceManager.getFileEntryForID(it->first);
+    if(!fileEntry) {
+      continue;
+    }
+
+    const base::FilePath filePath{fileEntry->getName().str()};
+    if(cachedHeaders_.count(filePath)) {
+      continue;
+    }
+
+    contents.clear();
+    llvm::raw_string_ostream stream(contents);
+    it->second.write(stream);
+    stream.flush();
+
+    auto cacheKey = headerCacheKeys_.find(filePath);
+    if(cacheKey != headerCacheKeys_.end()) {
+      DCHECK(headerRewriteCache_);
+      headerRewriteCache_->Store(cacheKey->second, contents);
+      headerCacheKeys_.erase(cacheKey);
+    }
+
+    writeGeneratedFile(filePath, contents);
+  }
+
+  // header without edits is stored too,
+  // so its annotations are not processed again
+  for(const auto& it : headerCacheKeys_) {
+    DCHECK(headerRewriteCache_);
+    headerRewriteCache_->Store(it.second, base::nullopt);
+  }
+  headerCacheKeys_.clear();
+}
+
+void ReflectTooling::writeGeneratedFile(
+  const base::FilePath& sourceFile
+  , base::StringPiece contents)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  const base::FilePath generatedFile = generatedFilePath(sourceFile);
+  if(generatedFile.empty()) {
+    return;
+  }
+  generatedFileWriter_.WriteIfChanged(generatedFile, contents);
+
+  if(settings_.emitDepfiles) {
+    depfileWriter_.WriteIfChanged(
+      base::FilePath{generatedFile.value() + kDepfileExtension}
+      , dependencyTracker_.FormatDepfile(sourceFile, generatedFile));
+  }
+}
+
+base::FilePath ReflectTooling::generatedFilePath(
+  const base::FilePath& sourceFile)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  const base::FilePath absoluteFile = base::MakeAbsoluteFilePath(sourceFile);
+  if(absoluteFile.empty()) {
+    LOG(ERROR)
+      << "unable to resolve path of rewritten file: "
+      << sourceFile;
+    return base::FilePath{};
+  }
+
+  const base::FilePath generatedFile
+    = GeneratedFilePath(settings_.outputDir, sourceRoot_, absoluteFile);
+
+  // different source files must never share generated file
+  auto it = generatedFileSources_.emplace(generatedFile, absoluteFile);
+  if(it.first->second != absoluteFile) {
+    LOG(ERROR)
+      << "generated file "
+      << generatedFile
+      << " of "
+      << absoluteFile
+      << " collides with generated file of "
+      << it.first->second;
+    return base::FilePath{};
+  }
+  return generatedFile;
+}
+
+void ReflectTooling::finishOutputs()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(headerRewriteCache_) {
+    headerRewriteCache_->LogStats();
+  }
+
+  if(annotationPrescanner_) {
+    annotationPrescanner_->LogStats();
+  }
+  headerCacheKeys_.clear();
+  cachedHeaders_.clear();
+  dependencyTracker_.Clear();
+
+  generatedFileWriter_.LogStats();
+  if(settings_.emitDepfiles) {
+    depfileWriter_.LogStats();
+  }
 }
 
 void ReflectTooling::executeCode(
@@ -62,21 +823,53 @@ void ReflectTooling::executeCode(
   , const clang::Decl* nodeDecl)
 {
   DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
-  TRACE_EVENT0("toplevel",
-               "plugin::FlexReflect::process_executeCode");
+  TRACE_EVENT_WITH_FLOW1("toplevel",
+                         "plugin::FlexReflect::process_executeCode",
+                         TRACE_ID_LOCAL(nodeDecl),
+                         TRACE_EVENT_FLAG_FLOW_OUT,
+                         "annotation",
+                         AnnotationTraceValue(
+                           matchResult, nodeDecl
+                           , "executeCode", processedAnnotation));
 
-#if defined(CLING_IS_ON)
-  DCHECK(clingInterpreter_);
-#endif // CLING_IS_ON
+  enterTranslationUnit(matchResult, rewriter);
+
+  // headers with interpreted code are never cached,
+  // so side effects of snippets do not depend on cache state
+  DCHECK(!isInCachedHeader(matchResult, nodeDecl));
+
+  std::unique_ptr<ScopedHeaderCacheCheck> headerCacheCheck
+    = checkHeaderCache(matchResult, rewriter, nodeDecl);
 
   DLOG(INFO) << "started processing of annotation: "
                << processedAnnotation;
 
+  recordDependencies(matchResult, nodeDecl, processedAnnotation);
+
+  if(!canExecuteSnippets()) {
+    VLOG(9)
+      << "skipped interpreted code of translation unit: "
+      << processedAnnotation.substr(0, 1000);
+    return;
+  }
+
 #if defined(CLING_IS_ON)
+  ::cling_utils::ClingInterpreter* interpreter = clingInterpreter();
+  if(!interpreter) {
+    LOG(ERROR)
+      << "Unable to execute C++ code at runtime: "
+      << "Cling interpreter is not registered.";
+    return;
+  }
+
   // execute code stored in annotation
   {
+    SnippetWatchdog::ScopedSnippet scopedSnippet(
+      snippetWatchdog_.get()
+      , AnnotationLocation(matchResult, nodeDecl)
+      , ContentHash(processedAnnotation));
     cling::Interpreter::CompilationResult compilationResult
-      = clingInterpreter_->executeCodeNoResult(
+      = interpreter->executeCodeNoResult(
           processedAnnotation);
     if(compilationResult
        != cling::Interpreter::Interpreter::kSuccess)
@@ -84,28 +877,19 @@ void ReflectTooling::executeCode(
       LOG(ERROR)
         << "ERROR while running cling code:"
         << processedAnnotation.substr(0, 1000);
+    } else if(scopedSnippet.IsOverBudget()) {
+      // like results of other methods, annotation is not removed
+      LOG(ERROR)
+        << "skipped result of over budget interpreted code: "
+        << processedAnnotation.substr(0, 1000);
+      return;
+    } else if(headerCacheCheck) {
+      headerCacheCheck->MarkSucceeded();
     }
   }
 
   // remove annotation from source file
-  {
-    clang::SourceLocation startLoc = nodeDecl->getBeginLoc();
-    // Note Stmt::getEndLoc() returns the source location prior to the
-    // token at the end of the line.  For instance, for:
-    // var = 123;
-    //      ^---- getEndLoc() points here.
-    clang::SourceLocation endLoc = nodeDecl->getEndLoc();
-
-    clang_utils::expandLocations(startLoc, endLoc, rewriter);
-
-    clang::ASTContext *context = matchResult.Context;
-    DCHECK(context);
-
-    rewriter.ReplaceText(
-      clang::SourceRange(startLoc, endLoc)
-      , "");
-  }
-
+  replaceDeclText(rewriter, nodeDecl, "");
 #else
   LOG(WARNING)
     << "Unable to execute C++ code at runtime: "
@@ -113,26 +897,27 @@ void ReflectTooling::executeCode(
 #endif // CLING_IS_ON
 }
 
-void ReflectTooling::executeCodeAndReplace(
+#if defined(CLING_IS_ON)
+bool ReflectTooling::runInterpretedCode(
   const std::string& processedAnnotation
-  , clang::AnnotateAttr* annotateAttr
   , const clang_utils::MatchResult& matchResult
   , clang::Rewriter& rewriter
-  , const clang::Decl* nodeDecl)
+  , const clang::Decl* nodeDecl
+  , cling::Value* result
+  , bool* isOverBudget)
 {
   DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
-  TRACE_EVENT0("toplevel",
-               "plugin::FlexReflect::process_executeCodeAndReplace");
-
-#if defined(CLING_IS_ON)
-  DCHECK(clingInterpreter_);
-#endif // CLING_IS_ON
+  DCHECK(result);
+  DCHECK(isOverBudget);
 
-  DLOG(INFO)
-    << "started processing of annotation: "
-    << processedAnnotation;
+  ::cling_utils::ClingInterpreter* interpreter = clingInterpreter();
+  if(!interpreter) {
+    LOG(ERROR)
+      << "Unable to execute C++ code at runtime: "
+      << "Cling interpreter is not registered.";
+    return false;
+  }
 
-#if defined(CLING_IS_ON)
   std::ostringstream sstr;
   // populate variables that can be used by interpreted code:
   //   clangMatchResult, clangRewriter, clangDecl
@@ -172,56 +957,117 @@ void ReflectTooling::executeCodeAndReplace(
   }
 
   // execute code stored in annotation
+  SnippetWatchdog::ScopedSnippet scopedSnippet(
+    snippetWatchdog_.get()
+    , AnnotationLocation(matchResult, nodeDecl)
+    , ContentHash(processedAnnotation));
+  cling::Interpreter::CompilationResult compilationResult
+    = interpreter->processCodeWithResult(
+        sstr.str(), *result);
+  if(compilationResult
+     != cling::Interpreter::Interpreter::kSuccess)
+  {
+    LOG(ERROR)
+      << "ERROR while running cling code:"
+      << processedAnnotation.substr(0, 1000);
+    return false;
+  }
+
+  /// \note result is allocated by interpreted code even if over budget,
+  /// so it is returned to caller that knows its type and frees it
+  *isOverBudget = scopedSnippet.IsOverBudget();
+  if(*isOverBudget) {
+    LOG(ERROR)
+      << "skipped result of over budget interpreted code: "
+      << processedAnnotation.substr(0, 1000);
+  }
+
+  return true;
+}
+#endif // CLING_IS_ON
+
+void ReflectTooling::executeCodeAndReplace(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT_WITH_FLOW1("toplevel",
+                         "plugin::FlexReflect::process_executeCodeAndReplace",
+                         TRACE_ID_LOCAL(nodeDecl),
+                         TRACE_EVENT_FLAG_FLOW_OUT,
+                         "annotation",
+                         AnnotationTraceValue(
+                           matchResult, nodeDecl
+                           , "executeCodeAndReplace", processedAnnotation));
+
+  enterTranslationUnit(matchResult, rewriter);
+
+  // headers with interpreted code are never cached,
+  // so side effects of snippets do not depend on cache state
+  DCHECK(!isInCachedHeader(matchResult, nodeDecl));
+
+  std::unique_ptr<ScopedHeaderCacheCheck> headerCacheCheck
+    = checkHeaderCache(matchResult, rewriter, nodeDecl);
+
+  DLOG(INFO)
+    << "started processing of annotation: "
+    << processedAnnotation;
+
+  recordDependencies(matchResult, nodeDecl, processedAnnotation);
+
+  if(!canExecuteSnippets()) {
+    VLOG(9)
+      << "skipped interpreted code of translation unit: "
+      << processedAnnotation.substr(0, 1000);
+    return;
+  }
+
+#if defined(CLING_IS_ON)
   cling::Value result;
+  bool isOverBudget = false;
+  if(!runInterpretedCode(
+       processedAnnotation, matchResult, rewriter, nodeDecl, &result
+       , &isOverBudget))
   {
-    cling::Interpreter::CompilationResult compilationResult
-      = clingInterpreter_->processCodeWithResult(
-          sstr.str(), result);
-    if(compilationResult
-       != cling::Interpreter::Interpreter::kSuccess)
-    {
-      LOG(ERROR)
-        << "ERROR while running cling code:"
-        << processedAnnotation.substr(0, 1000);
-    }
+    return;
   }
 
   // remove annotation from source file
   // replacing it with |cling::Value result|
   {
-    clang::SourceLocation startLoc = nodeDecl->getBeginLoc();
-    // Note Stmt::getEndLoc() returns the source location prior to the
-    // token at the end of the line.  For instance, for:
-    // var = 123;
-    //      ^---- getEndLoc() points here.
-    clang::SourceLocation endLoc = nodeDecl->getEndLoc();
-
-    clang_utils::expandLocations(startLoc, endLoc, rewriter);
-
     if(result.hasValue() && result.isValid()
         && !result.isVoid()) {
-      void* resOptionVoid = result.getAs<void*>();
-      auto resOption =
-        static_cast<llvm::Optional<std::string>*>(resOptionVoid);
+      /// \note frees memory allocated by interpreted code
+      std::unique_ptr<llvm::Optional<std::string>> resOption(
+        static_cast<llvm::Optional<std::string>*>(result.getAs<void*>()));
+      if(isOverBudget) {
+        return;
+      }
       if(resOption) {
         if(resOption->hasValue()) {
-            rewriter.ReplaceText(
-              clang::SourceRange(startLoc, endLoc)
-              , resOption->getValue());
+            replaceDeclText(rewriter, nodeDecl, resOption->getValue());
         } else {
           VLOG(9)
             << "ExecuteCodeAndReplace: kept old code."
             << " Nothing provided to perform rewriter.ReplaceText";
         }
-        delete resOption; /// \note frees resOptionVoid memory
       }
+    } else if(isOverBudget) {
+      return;
     } else {
       DLOG(INFO) << "ignored invalid "
                     "Cling result "
                     "for processedAnnotation: "
-                    << sstr.str();
+                    << processedAnnotation.substr(0, 1000);
     }
   }
+
+  if(headerCacheCheck) {
+    headerCacheCheck->MarkSucceeded();
+  }
 #else
   LOG(WARNING)
     << "Unable to execute C++ code at runtime: "
@@ -229,7 +1075,7 @@ void ReflectTooling::executeCodeAndReplace(
 #endif // CLING_IS_ON
 }
 
-void ReflectTooling::callFuncBySignature(
+void ReflectTooling::executeCodeAndEdit(
   const std::string& processedAnnotation
   , clang::AnnotateAttr* annotateAttr
   , const clang_utils::MatchResult& matchResult
@@ -237,12 +1083,116 @@ void ReflectTooling::callFuncBySignature(
   , const clang::Decl* nodeDecl)
 {
   DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
-  TRACE_EVENT0("toplevel",
-               "plugin::FlexReflect::callFuncBySignature");
+  TRACE_EVENT_WITH_FLOW1("toplevel",
+                         "plugin::FlexReflect::process_executeCodeAndEdit",
+                         TRACE_ID_LOCAL(nodeDecl),
+                         TRACE_EVENT_FLAG_FLOW_OUT,
+                         "annotation",
+                         AnnotationTraceValue(
+                           matchResult, nodeDecl
+                           , "executeCodeAndEdit", processedAnnotation));
+
+  enterTranslationUnit(matchResult, rewriter);
+
+  // headers with interpreted code are never cached,
+  // so side effects of snippets do not depend on cache state
+  DCHECK(!isInCachedHeader(matchResult, nodeDecl));
+
+  std::unique_ptr<ScopedHeaderCacheCheck> headerCacheCheck
+    = checkHeaderCache(matchResult, rewriter, nodeDecl);
+
+  DLOG(INFO)
+    << "started processing of annotation: "
+    << processedAnnotation;
+
+  recordDependencies(matchResult, nodeDecl, processedAnnotation);
+
+  if(!canExecuteSnippets()) {
+    VLOG(9)
+      << "skipped interpreted code of translation unit: "
+      << processedAnnotation.substr(0, 1000);
+    return;
+  }
 
 #if defined(CLING_IS_ON)
-  DCHECK(clingInterpreter_);
+  cling::Value result;
+  bool isOverBudget = false;
+  if(!runInterpretedCode(
+       processedAnnotation, matchResult, rewriter, nodeDecl, &result
+       , &isOverBudget))
+  {
+    return;
+  }
+
+  // apply all edits returned by single execution of interpreted code
+  if(result.hasValue() && result.isValid()
+      && !result.isVoid()) {
+    /// \note frees memory allocated by interpreted code
+    std::unique_ptr<ReflectEdits> edits(
+      static_cast<ReflectEdits*>(result.getAs<void*>()));
+    if(isOverBudget) {
+      return;
+    }
+    if(edits) {
+      TRACE_EVENT_WITH_FLOW1("toplevel",
+                             "plugin::FlexReflect::ApplyReflectEdits",
+                             TRACE_ID_LOCAL(nodeDecl),
+                             TRACE_EVENT_FLAG_FLOW_IN,
+                             "edits", edits->edits.size());
+      ApplyReflectEdits(rewriter, nodeDecl, *edits);
+    } else {
+      VLOG(9)
+        << "ExecuteCodeAndEdit: kept old code."
+        << " Nothing provided to edit";
+    }
+  } else if(isOverBudget) {
+    return;
+  } else {
+    DLOG(INFO) << "ignored invalid "
+                  "Cling result "
+                  "for processedAnnotation: "
+                  << processedAnnotation.substr(0, 1000);
+  }
+
+  if(headerCacheCheck) {
+    headerCacheCheck->MarkSucceeded();
+  }
+#else
+  LOG(WARNING)
+    << "Unable to execute C++ code at runtime: "
+    << "Cling is disabled.";
 #endif // CLING_IS_ON
+}
+
+void ReflectTooling::callFuncBySignature(
+  const std::string& processedAnnotation
+  , clang::AnnotateAttr* annotateAttr
+  , const clang_utils::MatchResult& matchResult
+  , clang::Rewriter& rewriter
+  , const clang::Decl* nodeDecl)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+  TRACE_EVENT_WITH_FLOW1("toplevel",
+                         "plugin::FlexReflect::callFuncBySignature",
+                         TRACE_ID_LOCAL(nodeDecl),
+                         TRACE_EVENT_FLAG_FLOW_OUT,
+                         "annotation",
+                         AnnotationTraceValue(
+                           matchResult, nodeDecl
+                           , "funccall", processedAnnotation));
+
+  enterTranslationUnit(matchResult, rewriter);
+
+  if(isInCachedHeader(matchResult, nodeDecl)) {
+    return;
+  }
+
+  std::unique_ptr<ScopedHeaderCacheCheck> headerCacheCheck
+    = checkHeaderCache(matchResult, rewriter, nodeDecl);
+
+  recordDependencies(matchResult, nodeDecl, base::StringPiece{});
+
+  DCHECK(sourceTransformRules_);
 
   std::vector<::flexlib::parsed_func> funcs_to_call;
   std::vector<::flexlib::parsed_func> parsedFuncs;
@@ -275,12 +1225,14 @@ void ReflectTooling::callFuncBySignature(
     << "generator for code: "
     << processedAnnotation;
 
+  std::vector<RuleCall> ruleCalls;
+  ruleCalls.reserve(funcs_to_call.size());
+
   for (const ::flexlib::parsed_func& func_to_call : funcs_to_call) {
       VLOG(9) << "main_module task "
                  << func_to_call.func_with_args_as_string_
                  << "... " << '\n';
 
-      DCHECK(sourceTransformRules_);
       auto callback = sourceTransformRules_->find(
         func_to_call.parsed_func_.func_name_);
       if(callback == sourceTransformRules_->end())
@@ -300,35 +1252,56 @@ void ReflectTooling::callFuncBySignature(
       }
 
       DCHECK(callback->second);
-      clang_utils::SourceTransformResult result
-        = callback->second.Run(clang_utils::SourceTransformOptions{
-            func_to_call
-            , matchResult
-            , rewriter
-            , nodeDecl
-            , parsedFuncs
-          });
-
-    // remove annotation from source file
-    // replacing it with callback result
-    {
-      clang::SourceLocation startLoc = nodeDecl->getBeginLoc();
-      // Note Stmt::getEndLoc() returns the source location prior to the
-      // token at the end of the line.  For instance, for:
-      // var = 123;
-      //      ^---- getEndLoc() points here.
-      clang::SourceLocation endLoc = nodeDecl->getEndLoc();
-
-      clang_utils::expandLocations(startLoc, endLoc, rewriter);
-
-      /// \note if result.replacer is nullptr, than we will keep old code
-      if(result.replacer != nullptr) {
-        rewriter.ReplaceText(
-          clang::SourceRange(startLoc, endLoc)
-          , result.replacer);
-      }
-    }
+      ruleCalls.push_back(RuleCall{
+        &func_to_call
+        , &callback->second
+        , settings_.pureRules.count(func_to_call.parsed_func_.func_name_) > 0
+      });
   } // for
+
+  // consecutive pure rules are executed concurrently,
+  // results are applied in order of declaration,
+  // so output is same as if rules executed one after another
+  RuleChain ruleChain(pureRulePool_.get());
+  std::vector<std::unique_ptr<RuleTask>> tasks;
+  tasks.reserve(ruleCalls.size());
+  for(const RuleCall& ruleCall : ruleCalls) {
+    tasks.push_back(std::make_unique<RuleTask>(
+      ruleCall, matchResult, rewriter, nodeDecl, parsedFuncs));
+    RuleChain::Step step;
+    step.runRule = base::BindRepeating(
+      &RuleTask::Run
+      , base::Unretained(tasks.back().get()));
+    step.applyResult = base::BindOnce(
+      [](ReflectTooling* tooling
+         , clang::Rewriter* rewriter
+         , const clang::Decl* nodeDecl
+         , const RuleTask* task)
+      {
+        // remove annotation from source file
+        // replacing it with callback result
+        /// \note if result.replacer is nullptr, than we will keep old code
+        /// (or rule already streamed its output
+        /// using `StreamingReplacementSink`)
+        if(task->result().replacer != nullptr) {
+          tooling->replaceDeclText(
+            *rewriter, nodeDecl, task->result().replacer);
+        }
+      }
+      , base::Unretained(this)
+      , base::Unretained(&rewriter)
+      , base::Unretained(nodeDecl)
+      , base::Unretained(tasks.back().get()));
+    step.isPure = ruleCall.isPure;
+    ruleChain.AddStep(std::move(step));
+  }
+
+  // lazy caches of `ASTContext` must not be filled concurrently
+  ruleChain.Run(base::BindRepeating(&PrecomputeASTQueries, nodeDecl));
+
+  if(headerCacheCheck) {
+    headerCacheCheck->MarkSucceeded();
+  }
 }
 
 } // namespace plugin
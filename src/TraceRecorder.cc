@@ -0,0 +1,145 @@
+#include <flex_reflect_plugin/TraceRecorder.hpp> // IWYU pragma: associated
+
+#include <base/bind.h>
+#include <base/logging.h>
+#include <base/files/file_util.h>
+#include <base/files/important_file_writer.h>
+#include <base/memory/ref_counted.h>
+#include <base/memory/ref_counted_memory.h>
+#include <base/trace_event/trace_buffer.h>
+#include <base/trace_event/trace_config.h>
+#include <base/trace_event/trace_event.h>
+#include <base/trace_event/trace_log.h>
+
+namespace plugin {
+
+namespace {
+
+static const char kTraceCategories[] = "toplevel";
+
+// collects fragments of trace,
+// flush may be finished on another thread
+class TraceOutput
+  : public base::RefCountedThreadSafe<TraceOutput> {
+public:
+  explicit TraceOutput(const base::FilePath& path)
+    : path_(path)
+  {
+    resultBuffer_.SetOutputCallback(output_.GetCallback());
+    resultBuffer_.Start();
+  }
+
+  void OnTraceDataCollected(
+    const scoped_refptr<base::RefCountedString>& eventsString
+    , bool hasMoreEvents)
+  {
+    resultBuffer_.AddFragment(eventsString->data());
+    if(hasMoreEvents) {
+      return;
+    }
+    resultBuffer_.Finish();
+
+    // `traceEvents` object is understood both by
+    // `chrome://tracing` and `ui.perfetto.dev`
+    const std::string json
+      = "{\"traceEvents\":" + output_.json_output + "}\n";
+    if(!base::CreateDirectory(path_.DirName())
+       || !base::ImportantFileWriter::WriteFileAtomically(path_, json))
+    {
+      LOG(ERROR)
+        << "unable to write trace file: "
+        << path_;
+      return;
+    }
+    LOG(INFO)
+      << "trace written to: "
+      << path_;
+  }
+
+private:
+  friend class base::RefCountedThreadSafe<TraceOutput>;
+
+  ~TraceOutput() = default;
+
+private:
+  base::FilePath path_;
+
+  base::trace_event::TraceResultBuffer resultBuffer_;
+
+  base::trace_event::TraceResultBuffer::SimpleOutput output_;
+
+  DISALLOW_COPY_AND_ASSIGN(TraceOutput);
+};
+
+} // namespace
+
+TraceRecorder::TraceRecorder()
+{
+  DETACH_FROM_SEQUENCE(sequence_checker_);
+}
+
+TraceRecorder::~TraceRecorder()
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(isRecording_) {
+    Stop(base::FilePath{});
+  }
+}
+
+bool TraceRecorder::Start(
+  const base::FilePath& path)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(isRecording_) {
+    LOG(WARNING)
+      << "trace recording already started";
+    return false;
+  }
+
+  // otherwise `Stop` without path would discard recorded trace
+  if(path.empty()) {
+    LOG(ERROR)
+      << "trace file path not provided, trace recording not started";
+    return false;
+  }
+
+  base::trace_event::TraceLog::GetInstance()->SetEnabled(
+    base::trace_event::TraceConfig(
+      kTraceCategories
+      , base::trace_event::RECORD_UNTIL_FULL)
+    , base::trace_event::TraceLog::RECORDING_MODE);
+
+  path_ = path;
+  isRecording_ = true;
+  return true;
+}
+
+bool TraceRecorder::Stop(
+  const base::FilePath& path)
+{
+  DCHECK_CALLED_ON_VALID_SEQUENCE(sequence_checker_);
+
+  if(!isRecording_) {
+    LOG(WARNING)
+      << "trace recording not started";
+    return false;
+  }
+
+  base::trace_event::TraceLog::GetInstance()->SetDisabled();
+  isRecording_ = false;
+
+  const base::FilePath outputPath = path.empty() ? path_ : path;
+  DCHECK(!outputPath.empty());
+
+  scoped_refptr<TraceOutput> traceOutput
+    = base::MakeRefCounted<TraceOutput>(outputPath);
+  base::trace_event::TraceLog::GetInstance()->Flush(
+    base::BindRepeating(
+      &TraceOutput::OnTraceDataCollected
+      , traceOutput));
+  return true;
+}
+
+} // namespace plugin
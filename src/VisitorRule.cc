@@ -0,0 +1,350 @@
+#include <flex_reflect_plugin/VisitorRule.hpp> // IWYU pragma: associated
+
+#include <flex_reflect_plugin/EditApplier.hpp>
+
+#include <clang/AST/ASTContext.h>
+#include <clang/AST/CXXInheritance.h>
+#include <clang/AST/DeclCXX.h>
+#include <clang/AST/RecursiveASTVisitor.h>
+#include <clang/Basic/SourceManager.h>
+#include <clang/Lex/Lexer.h>
+#include <clang/Rewrite/Core/Rewriter.h>
+
+#include <base/logging.h>
+#include <base/strings/string_number_conversions.h>
+#include <base/trace_event/trace_event.h>
+
+#include <string>
+#include <vector>
+
+namespace plugin {
+
+const char kMakeVisitorRule[] = "make_visitor";
+
+namespace {
+
+class DerivedClassCollector
+  : public clang::RecursiveASTVisitor<DerivedClassCollector> {
+public:
+  DerivedClassCollector(
+    const clang::CXXRecordDecl* base
+    , std::vector<const clang::CXXRecordDecl*>& derivedClasses)
+    : base_(base)
+    , derivedClasses_(derivedClasses)
+  {}
+
+  // class templates are collected too, so they are reported
+  // instead of being silently left without type id
+  bool VisitCXXRecordDecl(clang::CXXRecordDecl* record)
+  {
+    if(record->isThisDeclarationADefinition()
+       && record->isDerivedFrom(base_))
+    {
+      derivedClasses_.push_back(record);
+    }
+    return true;
+  }
+
+private:
+  const clang::CXXRecordDecl* base_;
+
+  std::vector<const clang::CXXRecordDecl*>& derivedClasses_;
+};
+
+// returns empty string if record can be edited by rule
+static std::string UneditableReason(
+  const clang::SourceManager& sourceManager
+  , const clang::CXXRecordDecl* record
+  , clang::FileID baseFileID)
+{
+  const std::string name = record->getQualifiedNameAsString();
+  if(!record->getIdentifier()) {
+    return "anonymous class derived from base";
+  }
+  if(record->isInAnonymousNamespace()) {
+    return name + " is declared in anonymous namespace";
+  }
+  if(record->isLocalClass()) {
+    return name + " is local class";
+  }
+  if(llvm::isa<clang::ClassTemplateSpecializationDecl>(record)
+     || record->getDescribedClassTemplate())
+  {
+    return name + " is class template";
+  }
+  if(record->isDependentContext()) {
+    return name + " is member of class template";
+  }
+  const clang::SourceLocation endLoc = record->getBraceRange().getEnd();
+  if(endLoc.isInvalid() || endLoc.isMacroID()
+     || sourceManager.isInSystemHeader(endLoc))
+  {
+    return name + " can not be edited";
+  }
+  if(sourceManager.getFileID(endLoc) != baseFileID) {
+    return name + " is not defined in same file as base class";
+  }
+  return std::string{};
+}
+
+// returns empty string if |derived| can be cast from |base|
+// using static_cast
+static std::string InheritanceError(
+  const clang::CXXRecordDecl* derived
+  , const clang::CXXRecordDecl* base)
+{
+  const std::string name = derived->getQualifiedNameAsString();
+  if(derived->isVirtuallyDerivedFrom(base)) {
+    return name + " uses virtual inheritance";
+  }
+  clang::CXXBasePaths paths(
+    /*FindAmbiguities*/ true
+    , /*RecordPaths*/ true
+    , /*DetectVirtual*/ true);
+  if(!derived->isDerivedFrom(base, paths)) {
+    return name + " is not derived from base";
+  }
+  if(paths.isAmbiguous(
+       base->getASTContext().getCanonicalType(
+         base->getASTContext().getRecordType(base))))
+  {
+    return name + " has ambiguous base class";
+  }
+  if(paths.front().Access != clang::AS_public) {
+    return name + " does not derive from base publicly";
+  }
+  return std::string{};
+}
+
+static std::string TypeIdMembers(
+  size_t typeId)
+{
+  return
+    "\n"
+    "  // generated by " + std::string(kMakeVisitorRule) + "\n"
+    " public:\n"
+    "  static constexpr unsigned kFlexVisitorTypeId = "
+      + base::NumberToString(typeId) + ";\n"
+    "\n"
+    "  unsigned flexVisitorTypeId() const noexcept override {\n"
+    "    return kFlexVisitorTypeId;\n"
+    "  }\n";
+}
+
+// pure virtual `flexVisitorTypeId` makes concrete class
+// that was not found by rule abstract, so its creation fails to compile
+static std::string BaseMembers()
+{
+  return
+    "\n"
+    "  // generated by " + std::string(kMakeVisitorRule) + "\n"
+    " public:\n"
+    "  virtual unsigned flexVisitorTypeId() const noexcept = 0;\n"
+    "\n"
+    "  // calls |visitor| with object casted to its dynamic type\n"
+    "  // (all overloads of |visitor| must return same type)\n"
+    "  template <typename Visitor>\n"
+    "  auto flexVisit(Visitor&& visitor) -> decltype(auto);\n"
+    "\n"
+    "  template <typename Visitor>\n"
+    "  auto flexVisit(Visitor&& visitor) const -> decltype(auto);\n";
+}
+
+// out of class definition of `flexVisit`,
+// |qualifier| is `const ` for const overload
+static std::string VisitDefinition(
+  const std::string& baseName
+  , const std::vector<std::string>& classNames
+  , const std::string& qualifier)
+{
+  DCHECK(!classNames.empty());
+  const std::string constSuffix = qualifier.empty() ? "" : " const";
+
+  std::string table;
+  for(const std::string& className : classNames) {
+    table +=
+      "    [](" + qualifier + baseName + "& object"
+        ", Visitor&& visitor) -> FlexResult {\n"
+      "      return std::forward<Visitor>(visitor)(\n"
+      "        static_cast<" + qualifier + className + "&>(object));\n"
+      "    },\n";
+  }
+
+  return
+    "\n"
+    "template <typename Visitor>\n"
+    "auto " + baseName + "::flexVisit(Visitor&& visitor)" + constSuffix
+      + " -> decltype(auto) {\n"
+    "  using FlexResult = decltype(std::declval<Visitor&&>()(\n"
+    "    std::declval<" + qualifier + classNames.front() + "&>()));\n"
+    "  using FlexThunk = FlexResult (*)(" + qualifier + baseName
+      + "&, Visitor&&);\n"
+    "  // indexed by kFlexVisitorTypeId\n"
+    "  static constexpr FlexThunk kFlexTable[] = {\n"
+    + table +
+    "  };\n"
+    "  return kFlexTable[flexVisitorTypeId()](\n"
+    "    *this, std::forward<Visitor>(visitor));\n"
+    "}\n";
+}
+
+} // namespace
+
+clang_utils::SourceTransformResult MakeVisitor(
+  const clang_utils::SourceTransformOptions& sourceTransformOptions)
+{
+  TRACE_EVENT0("toplevel",
+               "plugin::MakeVisitor");
+
+  const clang::CXXRecordDecl* base
+    = llvm::dyn_cast_or_null<clang::CXXRecordDecl>(
+        sourceTransformOptions.decl);
+  if(!base || !base->isThisDeclarationADefinition()) {
+    LOG(ERROR)
+      << kMakeVisitorRule
+      << ": annotated declaration is not definition of class";
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+  if(!base->isPolymorphic()) {
+    LOG(ERROR)
+      << kMakeVisitorRule
+      << ": "
+      << base->getQualifiedNameAsString()
+      << " is not polymorphic (virtual destructor required)";
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  clang::ASTContext& context = base->getASTContext();
+  const clang::SourceManager& sourceManager = context.getSourceManager();
+  const clang::FileID baseFileID = sourceManager.getFileID(
+    base->getBraceRange().getEnd());
+
+  std::vector<const clang::CXXRecordDecl*> derivedClasses;
+  {
+    DerivedClassCollector collector(base, derivedClasses);
+    collector.TraverseDecl(context.getTranslationUnitDecl());
+  }
+
+  std::vector<std::string> errors;
+  {
+    const std::string baseError
+      = UneditableReason(sourceManager, base, baseFileID);
+    if(!baseError.empty()) {
+      errors.push_back(baseError);
+    }
+  }
+  for(const clang::CXXRecordDecl* derived : derivedClasses) {
+    const std::string uneditableReason
+      = UneditableReason(sourceManager, derived, baseFileID);
+    if(!uneditableReason.empty()) {
+      errors.push_back(uneditableReason);
+      continue;
+    }
+    const std::string inheritanceError
+      = InheritanceError(derived, base);
+    if(!inheritanceError.empty()) {
+      errors.push_back(inheritanceError);
+    }
+  }
+  if(!errors.empty()) {
+    for(const std::string& error : errors) {
+      LOG(ERROR)
+        << kMakeVisitorRule
+        << ": "
+        << error;
+    }
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  if(!base->isAbstract()) {
+    VLOG(9)
+      << kMakeVisitorRule
+      << ": "
+      << base->getQualifiedNameAsString()
+      << " becomes abstract";
+  }
+
+  // dense ids of concrete derived classes in order of declaration
+  std::vector<std::string> classNames;
+
+  clang::Rewriter& rewriter = sourceTransformOptions.rewriter;
+  const clang::CXXRecordDecl* lastClass = base;
+  for(const clang::CXXRecordDecl* derived : derivedClasses) {
+    if(sourceManager.isBeforeInTranslationUnit(
+         lastClass->getBraceRange().getEnd()
+         , derived->getBraceRange().getEnd()))
+    {
+      lastClass = derived;
+    }
+    if(derived->isAbstract()) {
+      continue;
+    }
+    rewriter.InsertTextBefore(
+      derived->getBraceRange().getEnd()
+      , TypeIdMembers(classNames.size()));
+    classNames.push_back("::" + derived->getQualifiedNameAsString());
+  }
+
+  if(classNames.empty()) {
+    LOG(ERROR)
+      << kMakeVisitorRule
+      << ": hierarchy of "
+      << base->getQualifiedNameAsString()
+      << " has no concrete classes";
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  // member template is defined after all classes of hierarchy
+  // in namespace that encloses base class
+  const clang::DeclContext* lastClassContext
+    = lastClass->getDeclContext()->getRedeclContext();
+  if(!lastClassContext->isFileContext()
+     || !lastClassContext->Encloses(base->getDeclContext()))
+  {
+    LOG(ERROR)
+      << kMakeVisitorRule
+      << ": "
+      << lastClass->getQualifiedNameAsString()
+      << " must be declared in namespace of "
+      << base->getQualifiedNameAsString();
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+  const clang::SourceLocation afterLastClass
+    = clang::Lexer::findLocationAfterToken(
+        lastClass->getBraceRange().getEnd()
+        , clang::tok::semi
+        , sourceManager
+        , context.getLangOpts()
+        , /*SkipTrailingWhitespaceAndNewLine*/ false);
+  if(afterLastClass.isInvalid()) {
+    LOG(ERROR)
+      << kMakeVisitorRule
+      << ": unable to find end of "
+      << lastClass->getQualifiedNameAsString();
+    return clang_utils::SourceTransformResult{nullptr};
+  }
+
+  AddIncludeOnce(rewriter, base, "<utility>");
+
+  rewriter.InsertTextBefore(
+    base->getBraceRange().getEnd()
+    , BaseMembers());
+
+  const std::string baseName = "::" + base->getQualifiedNameAsString();
+  rewriter.InsertTextAfter(
+    afterLastClass
+    , "\n// generated by " + std::string(kMakeVisitorRule) + "\n"
+      + VisitDefinition(baseName, classNames, "")
+      + VisitDefinition(baseName, classNames, "const "));
+
+  VLOG(9)
+    << kMakeVisitorRule
+    << ": generated dispatch table of "
+    << classNames.size()
+    << " classes for "
+    << base->getQualifiedNameAsString();
+
+  return clang_utils::SourceTransformResult{nullptr};
+}
+
+} // namespace plugin
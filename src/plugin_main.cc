@@ -47,6 +47,9 @@ class FlexReflect
     ::plugin::AbstractManager& manager
     , const std::string& plugin)
     : ::plugin::ToolPlugin{manager, plugin}
+    , eventHandler_{
+        FlexReflectSettings::FromConfiguration(
+          metadata()->configuration())}
   {
     DETACH_FROM_SEQUENCE(sequence_checker_);
   }
@@ -154,7 +157,7 @@ class FlexReflect
   }
 
 private:
-  FlexReflectEventHandler eventHandler_{};
+  FlexReflectEventHandler eventHandler_;
 
   DISALLOW_COPY_AND_ASSIGN(FlexReflect);
 };
@@ -31,3 +31,11 @@ target_compile_definitions( ${perf_test_runner} PUBLIC
   USE_GTEST_TEST=1
   GTEST_PERF_SUITE=1
   PERF_TEST=1)
+
+macro(flex_reflect_test_perf test_name source_list)
+  set( PERF_TEST_ARGS
+    "--gtest_repeat=1"
+    "--test-data-dir=${CMAKE_CURRENT_SOURCE_DIR}/data/")
+
+  flex_reflect_test("${test_name}" "${source_list}" "${PERF_TEST_ARGS}" "${perf_test_runner}")
+endmacro()
@@ -10,9 +10,26 @@ add_custom_command( TARGET ${ROOT_PROJECT_NAME}-i18n POST_BUILD
 
 list(APPEND flex_reflect_unittests
   #annotations/asio_guard_annotations_unittest.cc
+  annotations/annotation_prescanner_unittest.cc
+  annotations/annotation_tokenizer_unittest.cc
+  annotations/snippet_validator_unittest.cc
+  cache/header_rewrite_cache_unittest.cc
+  dependencies/dependency_tracker_unittest.cc
+  edits/edit_applier_unittest.cc
+  output/generated_file_writer_unittest.cc
+  output/streaming_replacement_sink_unittest.cc
+  rules/hash_eq_rule_unittest.cc
+  rules/pooled_rule_unittest.cc
+  rules/rule_chain_unittest.cc
+  rules/visitor_rule_unittest.cc
+)
+list(APPEND flex_reflect_perftests
+  annotations/annotation_tokenizer_perftest.cc
 )
 list(APPEND flex_reflect_unittest_utils
   #"allocator/partition_allocator/arm_bti_test_functions.h"
+  rules/rule_test_util.h
+  rules/rule_test_util.cc
 )
 
 list(REMOVE_DUPLICATES flex_reflect_unittests)
@@ -32,3 +49,12 @@ foreach(FILEPATH ${flex_reflect_unittests})
   flex_reflect_test_gtest(${ROOT_PROJECT_NAME}-flex_reflect-${FILENAME_WITHOUT_EXT}
     "${test_sources}")
 endforeach()
+
+list(REMOVE_DUPLICATES flex_reflect_perftests)
+list(TRANSFORM flex_reflect_perftests PREPEND ${FLEX_REFLECT_SOURCES_PATH})
+
+foreach(FILEPATH ${flex_reflect_perftests})
+  get_filename_component(FILENAME_WITHOUT_EXT ${FILEPATH} NAME_WE)
+  flex_reflect_test_perf(${ROOT_PROJECT_NAME}-flex_reflect-${FILENAME_WITHOUT_EXT}
+    "${FILEPATH}")
+endforeach()